@@ -0,0 +1,331 @@
+// COPYRIGHT: Larisa Florea
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "buffer.h"
+#include "policy.h"
+#include "reclaim.h"
+
+// header written over the first bytes of a buffer while it is cached
+typedef struct free_buffer {
+	struct free_buffer *next;
+	size_t dirty;
+} free_buffer;
+
+// return the size class of a buffer or -1 if it is too big to be cached
+static int size_class(size_t size)
+{
+	int c = 0;
+	while (c < BUFFER_CLASSES && ((size_t)1 << (c + BUFFER_MIN_SHIFT)) < size)
+		c++;
+
+	if (c == BUFFER_CLASSES)
+		return -1;
+	return c;
+}
+
+// return the number of bytes really reserved for a buffer of a given size
+size_t buffer_capacity(size_t size)
+{
+	int c = size_class(size);
+	if (c >= 0)
+		return (size_t)1 << (c + BUFFER_MIN_SHIFT);
+
+	// buffers bigger than the last class are mapped page by page
+	size_t page = 4096;
+	return (size + page - 1) & ~(page - 1);
+}
+
+// map a zeroed zone, aligned for huge pages if needed
+static void *map_zone(size_t capacity)
+{
+#ifdef BUFFER_HUGE_PAGES
+	if (capacity >= BUFFER_HUGE_PAGE) {
+		size_t length = capacity + BUFFER_HUGE_PAGE;
+		uint8_t *zone = mmap(NULL, length, PROT_READ | PROT_WRITE,
+							 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (zone == MAP_FAILED)
+			return NULL;
+
+		// trim the unaligned head and the tail of the zone
+		uintptr_t addr = (uintptr_t)zone;
+		uintptr_t aligned = (addr + BUFFER_HUGE_PAGE - 1)
+							& ~((uintptr_t)BUFFER_HUGE_PAGE - 1);
+		if (aligned != addr)
+			munmap(zone, aligned - addr);
+		if (aligned + capacity != addr + length)
+			munmap((void *)(aligned + capacity),
+				   addr + length - aligned - capacity);
+
+		madvise((void *)aligned, capacity, MADV_HUGEPAGE);
+		return (void *)aligned;
+	}
+#endif
+	void *zone = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+					  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (zone == MAP_FAILED)
+		return NULL;
+	return zone;
+}
+
+void buffer_cache_init(buffer_cache_t *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->max_bytes = BUFFER_CACHE_MAX;
+}
+
+// release every buffer that is kept in the cache
+void buffer_cache_destroy(buffer_cache_t *cache)
+{
+	reclaim_batch_t batch = {NULL, NULL, 0, 0};
+	for (int c = 0; c < BUFFER_CLASSES; c++) {
+		free_buffer *curr = cache->free_list[c];
+		size_t capacity = (size_t)1 << (c + BUFFER_MIN_SHIFT);
+		while (curr) {
+			free_buffer *next = curr->next;
+			reclaim_add(&batch, curr, capacity);
+			curr = next;
+		}
+		cache->free_list[c] = NULL;
+	}
+	reclaim_flush(&batch);
+	cache->cached_bytes = 0;
+	cache->cached_buffers = 0;
+}
+
+// change the limit of the cache, dropping buffers until it is respected
+void buffer_cache_limit(buffer_cache_t *cache, uint64_t max_bytes)
+{
+	cache->max_bytes = max_bytes;
+
+	// the biggest buffers are dropped first
+	for (int c = BUFFER_CLASSES - 1; c >= 0; c--) {
+		size_t capacity = (size_t)1 << (c + BUFFER_MIN_SHIFT);
+		while (cache->free_list[c] && cache->cached_bytes > max_bytes) {
+			free_buffer *curr = cache->free_list[c];
+			cache->free_list[c] = curr->next;
+			cache->cached_bytes -= capacity;
+			cache->cached_buffers--;
+			cache->evictions++;
+			reclaim_buffer(curr, capacity);
+		}
+	}
+}
+
+// return a zeroed buffer of at least size bytes
+void *buffer_get(buffer_cache_t *cache, size_t size)
+{
+	int c = size_class(size);
+	size_t capacity = buffer_capacity(size);
+
+	if (c >= 0 && cache->free_list[c]) {
+		free_buffer *buffer = cache->free_list[c];
+		cache->free_list[c] = buffer->next;
+		cache->cached_bytes -= capacity;
+		cache->cached_buffers--;
+		cache->hits++;
+
+		// only the bytes written before (and the header) must be cleared
+		size_t dirty = buffer->dirty;
+		if (dirty < sizeof(free_buffer))
+			dirty = sizeof(free_buffer);
+		memset(buffer, 0, dirty);
+		return buffer;
+	}
+
+	cache->misses++;
+	if (capacity < BUFFER_MMAP_THRESHOLD)
+		return calloc(capacity, sizeof(int8_t));
+	return map_zone(capacity);
+}
+
+// give a buffer back to the cache; dirty is the number of bytes
+// from its beginning that could have been written
+void buffer_put(buffer_cache_t *cache, void *buffer, size_t size, size_t dirty)
+{
+	if (!buffer)
+		return;
+
+	int c = size_class(size);
+	size_t capacity = buffer_capacity(size);
+#if VMA_STORAGE == VMA_STORAGE_DIRECT
+	// nothing is kept, every buffer comes straight from malloc/mmap
+	c = -1;
+#endif
+	// with workers, a big dirty buffer is released by them instead of
+	// paying its madvise here, on the thread that executes the commands
+	int mapped = capacity >= BUFFER_MMAP_THRESHOLD && dirty;
+	if (c < 0 || cache->cached_bytes + capacity > cache->max_bytes ||
+		(mapped && reclaim_active())) {
+		cache->evictions++;
+		reclaim_buffer(buffer, size);
+		return;
+	}
+
+	// the pages of a mapped buffer are given back to the kernel,
+	// which will provide them zeroed at the next access
+	if (mapped) {
+#ifdef BUFFER_MADV_FREE
+		madvise(buffer, capacity, MADV_FREE);
+#else
+		madvise(buffer, capacity, MADV_DONTNEED);
+		dirty = 0;
+#endif
+	}
+
+	free_buffer *header = buffer;
+	header->next = cache->free_list[c];
+	header->dirty = dirty;
+	cache->free_list[c] = header;
+	cache->cached_bytes += capacity;
+	cache->cached_buffers++;
+}
+
+// release a buffer without keeping it in the cache
+void buffer_release(void *buffer, size_t size)
+{
+	if (!buffer)
+		return;
+
+	size_t capacity = buffer_capacity(size);
+	if (capacity < BUFFER_MMAP_THRESHOLD)
+		free(buffer);
+	else
+		munmap(buffer, capacity);
+}
+
+// change the size of a buffer, keeping its content; the buffer is moved
+// only when it has to change between malloc and mmap
+void *buffer_resize(buffer_cache_t *cache, void *buffer, size_t size,
+					size_t new_size, size_t dirty)
+{
+	size_t capacity = buffer_capacity(size);
+	size_t new_capacity = buffer_capacity(new_size);
+
+	// the bytes that are cut off must be zero if they are reused later
+	if (new_size < dirty) {
+		memset((int8_t *)buffer + new_size, 0, dirty - new_size);
+		dirty = new_size;
+	}
+
+	if (capacity == new_capacity)
+		return buffer;
+
+	if (capacity < BUFFER_MMAP_THRESHOLD &&
+		new_capacity < BUFFER_MMAP_THRESHOLD) {
+		int8_t *new_buffer = realloc(buffer, new_capacity);
+		if (new_buffer && new_capacity > capacity)
+			memset(new_buffer + capacity, 0, new_capacity - capacity);
+		return new_buffer;
+	}
+
+	if (capacity >= BUFFER_MMAP_THRESHOLD &&
+		new_capacity >= BUFFER_MMAP_THRESHOLD) {
+		// the kernel moves the pages, new ones are zeroed
+		void *new_buffer = mremap(buffer, capacity, new_capacity,
+								  MREMAP_MAYMOVE);
+		if (new_buffer == MAP_FAILED)
+			return NULL;
+		return new_buffer;
+	}
+
+	void *new_buffer = buffer_get(cache, new_size);
+	if (!new_buffer)
+		return NULL;
+	memcpy(new_buffer, buffer, dirty);
+	buffer_put(cache, buffer, size, dirty);
+	return new_buffer;
+}
+
+// add a mapping to a buffer; the first call creates the reference, which
+// also counts the miniblock that owned the buffer
+buffer_ref_t *buffer_share(buffer_ref_t *ref, void *buffer, size_t size)
+{
+	if (!ref) {
+		ref = malloc(sizeof(*ref));
+		if (!ref)
+			return NULL;
+		ref->buffer = buffer;
+		ref->size = size;
+		ref->refs = 1;
+		ref->map = NULL;
+		ref->map_length = 0;
+		ref->map_shared = 0;
+	}
+
+	ref->refs++;
+	return ref;
+}
+
+// remove a mapping of a buffer; the last one unmaps the file or gives the
+// buffer to the cache (releases it, without a cache)
+void buffer_unshare(buffer_cache_t *cache, buffer_ref_t *ref)
+{
+	if (--ref->refs)
+		return;
+
+	// any of the mappings could have written the whole buffer
+	if (ref->map)
+		munmap(ref->map, ref->map_length);
+	else if (cache)
+		buffer_put(cache, ref->buffer, ref->size, ref->size);
+	else
+		reclaim_buffer(ref->buffer, ref->size);
+	free(ref);
+}
+
+// map length bytes of a file, from offset; a private mapping is copied on
+// write, while the writes to a shared one reach the file
+buffer_ref_t *buffer_map_file(const char *path, uint64_t offset,
+							  size_t length, int shared)
+{
+	// opening a FIFO or a device must not block the command thread
+	int fd = open(path, (shared ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+	if (fd < 0)
+		return NULL;
+
+	// only regular files are mapped; the pages after their end cannot be
+	// accessed
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !length ||
+		(uint64_t)st.st_size < offset ||
+		(uint64_t)st.st_size - offset < length) {
+		close(fd);
+		return NULL;
+	}
+
+	// the offset of a mapping must be a multiple of the page size
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t delta = offset % page;
+	void *map = mmap(NULL, length + delta, PROT_READ | PROT_WRITE,
+					 shared ? MAP_SHARED : MAP_PRIVATE, fd, offset - delta);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	buffer_ref_t *ref = malloc(sizeof(*ref));
+	if (!ref) {
+		munmap(map, length + delta);
+		return NULL;
+	}
+	ref->buffer = (uint8_t *)map + delta;
+	ref->size = length;
+	ref->refs = 1;
+	ref->map = map;
+	ref->map_length = length + delta;
+	ref->map_shared = shared;
+	return ref;
+}
+
+// write the changes of a file mapping to the file
+int buffer_sync(buffer_ref_t *ref)
+{
+	if (!ref->map)
+		return 0;
+	return msync(ref->map, ref->map_length, MS_SYNC) == 0;
+}
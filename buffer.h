@@ -0,0 +1,66 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// buffers are grouped in power-of-two size classes (2^4 .. 2^30 bytes)
+#define BUFFER_MIN_SHIFT 4
+#define BUFFER_MAX_SHIFT 30
+#define BUFFER_CLASSES (BUFFER_MAX_SHIFT - BUFFER_MIN_SHIFT + 1)
+
+// classes starting from this size are backed by mmap instead of malloc
+#define BUFFER_MMAP_THRESHOLD (128 * 1024)
+
+// default limit for the bytes kept in the cache
+#define BUFFER_CACHE_MAX (64ULL * 1024 * 1024)
+
+// build with -DBUFFER_HUGE_PAGES to align big buffers for huge pages
+#define BUFFER_HUGE_PAGE (2 * 1024 * 1024)
+
+typedef struct {
+	void *free_list[BUFFER_CLASSES];
+	uint64_t max_bytes;
+	uint64_t cached_bytes;
+	uint64_t cached_buffers;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} buffer_cache_t;
+
+// a buffer mapped by several miniblocks or backed by a file; only the
+// last miniblock that uses it gives it back
+typedef struct {
+	void *buffer;
+	size_t size; // the size the buffer was allocated with
+	uint64_t refs;
+	void *map; // the mapping of the file (buffer points inside it), or NULL
+	size_t map_length;
+	int map_shared; // the writes to the mapping reach the file
+} buffer_ref_t;
+
+void buffer_cache_init(buffer_cache_t *cache);
+
+void buffer_cache_destroy(buffer_cache_t *cache);
+
+void buffer_cache_limit(buffer_cache_t *cache, uint64_t max_bytes);
+
+size_t buffer_capacity(size_t size);
+
+void *buffer_get(buffer_cache_t *cache, size_t size);
+
+void buffer_put(buffer_cache_t *cache, void *buffer, size_t size, size_t dirty);
+
+void buffer_release(void *buffer, size_t size);
+
+void *buffer_resize(buffer_cache_t *cache, void *buffer, size_t size,
+					size_t new_size, size_t dirty);
+
+buffer_ref_t *buffer_share(buffer_ref_t *ref, void *buffer, size_t size);
+
+void buffer_unshare(buffer_cache_t *cache, buffer_ref_t *ref);
+
+buffer_ref_t *buffer_map_file(const char *path, uint64_t offset,
+							  size_t length, int shared);
+
+int buffer_sync(buffer_ref_t *ref);
@@ -0,0 +1,512 @@
+// COPYRIGHT: Larisa Florea
+
+#include "command.h"
+
+arena_t *(*command_named_arena)(const char *name, int *found);
+
+// return the number of arguments the command must have
+long command_arguments(const command_t *cmd)
+{
+	switch (cmd->type) {
+	case 2: // DEALLOC_ARENA
+	case 7: // PMAP (the zone is optional)
+	case 9: // CACHE_STATS
+	case 14: // METADATA
+	case 15: // COMPACT (the address is optional)
+	case 18: // ATTACH (the name is optional)
+	case 19: // PMAP_SUMMARY
+	case 23: // FRAG
+		return 0;
+	case 1: // ALLOC_ARENA
+	case 4: // FREE_BLOCK
+	case 8: // MPROTECT
+	case 10: // CACHE_LIMIT
+	case 22: // SYNC
+	case 16: // COMPACT_AUTO
+	case 17: // HEATMAP
+		return 1;
+	case 3: // ALLOC_BLOCK
+	case 5: // READ
+	case 6: // WRITE
+	case 11: // RESIZE
+		return 2;
+	case 20: // MAP_SHARED (the arena is optional)
+		return 3;
+	case 21: // MAP_FILE (the mode is the last argument)
+		return 4;
+	case 12: // READV
+	case 13: // WRITEV
+		if (cmd->argc < 1)
+			return 1;
+		// clamped before it is doubled: more segments are never complete
+		if (cmd->argv[0] > COMMAND_MAX_SEGMENTS)
+			return 1 + 2 * (long)(COMMAND_MAX_SEGMENTS + 1);
+		return 1 + 2 * (long)cmd->argv[0];
+	default:
+		return 0;
+	}
+}
+
+// read n more numbers of the command from the input
+void read_arguments(command_t *cmd, long n)
+{
+	if (n <= 0)
+		return;
+
+	uint64_t *argv = realloc(cmd->argv, (cmd->argc + n) * sizeof(uint64_t));
+	if (!argv) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+	cmd->argv = argv;
+
+	while (n) {
+		unsigned long long x = 0;
+		scanf("%llu", &x);
+		cmd->argv[cmd->argc++] = x;
+		n--;
+	}
+}
+
+// read the rest of the line (permissions or options)
+void read_options(command_t *cmd)
+{
+	cmd->data = malloc(200 * sizeof(int8_t));
+	if (!cmd->data) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+	cmd->data[0] = '\0';
+	scanf("%199[^\n]", (char *)cmd->data);
+	cmd->len = strlen((char *)cmd->data);
+}
+
+// add a number to the arguments of the command
+void push_argument(command_t *cmd, uint64_t x)
+{
+	uint64_t *argv = realloc(cmd->argv, (cmd->argc + 1) * sizeof(uint64_t));
+	if (!argv) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+	cmd->argv = argv;
+	cmd->argv[cmd->argc++] = x;
+}
+
+// read an optional name from the rest of the line
+void read_name(command_t *cmd)
+{
+	char name[200] = "";
+	read_options(cmd);
+	if (!cmd->data)
+		return;
+
+	if (sscanf((char *)cmd->data, "%199s", name) != 1)
+		name[0] = '\0';
+	strcpy((char *)cmd->data, name);
+	cmd->len = strlen(name);
+}
+
+// build the segments of a vectored command from its arguments
+segment_t *command_segments(const command_t *cmd, long *n)
+{
+	*n = (cmd->argc - 1) / 2;
+	segment_t *segments = malloc((*n + 1) * sizeof(segment_t));
+	if (!segments) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		*n = 0;
+		return NULL;
+	}
+
+	for (long i = 0; i < *n; i++) {
+		segments[i].address = cmd->argv[1 + 2 * i];
+		segments[i].size = cmd->argv[2 + 2 * i];
+	}
+
+	return segments;
+}
+
+// add up the sizes of the segments; return 0 if the sum does not fit
+int command_total(const segment_t *segments, long n, uint64_t *total)
+{
+	*total = 0;
+	for (long i = 0; i < n; i++) {
+		if (segments[i].size >= UINT64_MAX - *total)
+			return 0;
+		*total += segments[i].size;
+	}
+	return 1;
+}
+
+// drop the segments of a vectored command that has too many of them,
+// adding up their sizes without keeping them; return 0 if the sum does
+// not fit
+static int skip_segments(uint64_t *total)
+{
+	uint64_t x = 0;
+	long numbers = 0;
+	int c, digits = 0, sized = 1;
+
+	*total = 0;
+	do {
+		c = getchar();
+		if (c >= '0' && c <= '9') {
+			// like scanf, a number that is too big saturates
+			if (x > (UINT64_MAX - (c - '0')) / 10)
+				x = UINT64_MAX;
+			else
+				x = 10 * x + (c - '0');
+			digits = 1;
+			continue;
+		}
+
+		// the sizes are the second number of each pair
+		if (digits && numbers++ % 2) {
+			if (x >= UINT64_MAX - *total)
+				sized = 0;
+			else
+				*total += x;
+		}
+		x = 0;
+		digits = 0;
+	} while (c != EOF && c != '\n');
+
+	if (c == '\n')
+		ungetc(c, stdin);
+	return sized;
+}
+
+// read a command of the text protocol; return 0 at the end of the input
+int parse_command(arena_t *arena, command_t *cmd)
+{
+	char name[50];
+	memset(cmd, 0, sizeof(*cmd));
+
+	if (scanf("%49s", name) != 1)
+		return 0;
+
+	cmd->type = convert(name);
+	switch (cmd->type) {
+	case 6: // WRITE
+		read_arguments(cmd, 2);
+		if (!arena) {
+			getchar();
+			read_characters(cmd->argv[1]);
+			break;
+		}
+		cmd->data = text(arena, cmd->argv[0], cmd->argv[1]);
+		if (cmd->data)
+			cmd->len = strlen((char *)cmd->data);
+		cmd->checked = 1;
+		break;
+
+	case 8: // MPROTECT
+		read_arguments(cmd, 1);
+		read_options(cmd);
+		break;
+
+	case 11: // RESIZE
+		read_arguments(cmd, 2);
+		read_options(cmd);
+		break;
+
+	case 7: // PMAP
+	case 15: { // COMPACT
+		unsigned long long x[2];
+		int n = 0;
+		read_options(cmd);
+		if (cmd->data)
+			n = sscanf((char *)cmd->data, "%llu %llu", &x[0], &x[1]);
+		if (n > 0) {
+			cmd->argv = malloc(n * sizeof(uint64_t));
+			for (int i = 0; cmd->argv && i < n; i++)
+				cmd->argv[cmd->argc++] = x[i];
+		}
+		free(cmd->data);
+		cmd->data = NULL;
+		cmd->len = 0;
+		break;
+	}
+
+	case 18: // ATTACH
+		read_name(cmd);
+		break;
+
+	case 20: // MAP_SHARED
+		read_arguments(cmd, 3);
+		read_name(cmd);
+		break;
+
+	case 21: { // MAP_FILE
+		char path[200] = "";
+		read_arguments(cmd, 1);
+		scanf("%199s", path);
+		read_arguments(cmd, 2);
+
+		// the path is the data of the command, the mode an argument
+		read_options(cmd);
+		push_argument(cmd, cmd->data && strstr((char *)cmd->data, "SHARED"));
+		free(cmd->data);
+		cmd->data = malloc(strlen(path) + 1);
+		if (cmd->data)
+			strcpy((char *)cmd->data, path);
+		cmd->len = cmd->data ? strlen(path) : 0;
+		break;
+	}
+
+	case 12: // READV
+	case 13: { // WRITEV
+		int invalid = 0;
+		read_arguments(cmd, 1);
+		if (cmd->argc < 1 || cmd->argv[0] > COMMAND_MAX_SEGMENTS) {
+			// the segments are not kept: the rest of the line is dropped,
+			// with the data of WRITEV if its size is known
+			uint64_t total;
+			if (skip_segments(&total) && cmd->type == 13) {
+				getchar();
+				read_characters(total);
+			}
+			free_command(cmd);
+			cmd->type = -1;
+			break;
+		}
+		read_arguments(cmd, 2 * cmd->argv[0]);
+		if (cmd->type == 13) {
+			long n;
+			uint64_t total = 0;
+			segment_t *segments = command_segments(cmd, &n);
+
+			// without a total, the data that follows cannot be skipped
+			int sized = segments && command_total(segments, n, &total);
+			if (!sized) {
+				invalid = 1;
+			} else if (arena) {
+				cmd->data = text_vector(arena, segments, n);
+				if (cmd->data)
+					cmd->len = total;
+				cmd->checked = 1;
+			} else {
+				getchar();
+				read_characters(total);
+			}
+			free(segments);
+		}
+
+		if (invalid) {
+			free_command(cmd);
+			cmd->type = -1;
+		}
+		break;
+	}
+
+	default:
+		read_arguments(cmd, command_arguments(cmd));
+		break;
+	}
+	getchar();
+
+	return 1;
+}
+
+void execute_write(arena_t *arena, command_t *cmd)
+{
+	uint64_t address = cmd->argv[0], size = cmd->len;
+
+	// the text protocol verifies the write while it reads the data
+	if (!cmd->checked) {
+		uint64_t accepted;
+		if (!check_write(arena, address, cmd->argv[1], &accepted))
+			return;
+		if (accepted < size)
+			size = accepted;
+	}
+
+	if (cmd->data)
+		write(arena, address, size, cmd->data);
+}
+
+void execute_write_vector(arena_t *arena, command_t *cmd)
+{
+	long n;
+	segment_t *segments = command_segments(cmd, &n);
+	if (!segments)
+		return;
+
+	int valid;
+	if (cmd->checked)
+		valid = resolve_segments(arena, segments, n, 2) == 0;
+	else
+		valid = check_vector(arena, segments, n);
+
+	uint64_t total;
+	if (valid && command_total(segments, n, &total) && cmd->data &&
+		cmd->len >= total)
+		write_vector(arena, segments, n, cmd->data);
+	free(segments);
+}
+
+// map a miniblock of this arena or, in server mode, of a named arena
+void execute_map_shared(arena_t *arena, command_t *cmd)
+{
+	arena_t *source = arena;
+	if (cmd->len) {
+		int found = 0;
+		if (!command_named_arena) {
+			printf("Named arenas are only available in server mode.\n");
+			return;
+		}
+		source = command_named_arena((char *)cmd->data, &found);
+		if (!found) {
+			printf("Invalid arena for map.\n");
+			return;
+		}
+	}
+
+	map_shared(arena, cmd->argv[0], cmd->argv[1], source, cmd->argv[2]);
+}
+
+// execute a command; return 0 when the program must stop
+int execute_command(arena_t **arena, command_t *cmd)
+{
+	uint64_t *argv = cmd->argv;
+	long n;
+
+	if (cmd->type < 0 || cmd->argc < command_arguments(cmd)) {
+		printf("Invalid command. Please try again.\n");
+		return 1;
+	}
+
+	// the named arenas are kept by the server (see session.c)
+	if (cmd->type == 18) {
+		printf("Named arenas are only available in server mode.\n");
+		return 1;
+	}
+
+	if (!*arena && cmd->type != 1) {
+		printf("The arena was not allocated.\n");
+		return cmd->type != 2;
+	}
+
+	switch (cmd->type) {
+	case 1: // ALLOC_ARENA
+		// the arena in use (maybe shared by name) is never replaced
+		if (*arena) {
+			printf("The arena was already allocated.\n");
+			break;
+		}
+		*arena = alloc_arena(argv[0]);
+		break;
+
+	case 2: // DEALLOC_ARENA
+		dealloc_arena(*arena);
+		free(*arena);
+		*arena = NULL;
+		return 0;
+
+	case 3: // ALLOC_BLOCK
+		alloc_block(*arena, argv[0], argv[1]);
+		break;
+
+	case 4: // FREE_BLOCK
+		free_block(*arena, argv[0]);
+		break;
+
+	case 5: // READ
+		read(*arena, argv[0], argv[1]);
+		break;
+
+	case 6: // WRITE
+		execute_write(*arena, cmd);
+		break;
+
+	case 7: // PMAP
+		if (cmd->argc >= 2)
+			pmap_range(*arena, argv[0], argv[1]);
+		else
+			pmap(*arena);
+		break;
+
+	case 8: // MPROTECT
+		if (cmd->data)
+			mprotect(*arena, argv[0], cmd->data);
+		break;
+
+	case 9: // CACHE_STATS
+		cache_stats(*arena);
+		break;
+
+	case 10: // CACHE_LIMIT
+		cache_limit(*arena, argv[0]);
+		break;
+
+	case 11: // RESIZE
+		resize(*arena, argv[0], argv[1],
+			   cmd->data && strstr((char *)cmd->data, "MOVE"));
+		break;
+
+	case 12: { // READV
+		segment_t *segments = command_segments(cmd, &n);
+		if (segments)
+			read_vector(*arena, segments, n);
+		free(segments);
+		break;
+	}
+
+	case 13: // WRITEV
+		execute_write_vector(*arena, cmd);
+		break;
+
+	case 14: // METADATA
+		metadata(*arena);
+		break;
+
+	case 15: // COMPACT
+		compact(*arena, cmd->argc == 0, cmd->argc ? argv[0] : 0);
+		break;
+
+	case 16: // COMPACT_AUTO
+		compact_auto(*arena, argv[0]);
+		break;
+
+	case 17: // HEATMAP
+		heatmap(*arena, argv[0]);
+		break;
+
+	case 19: // PMAP_SUMMARY
+		pmap_summary(*arena);
+		break;
+
+	case 20: // MAP_SHARED
+		execute_map_shared(*arena, cmd);
+		break;
+
+	case 21: // MAP_FILE
+		if (cmd->data)
+			map_file(*arena, argv[0], (char *)cmd->data, argv[1], argv[2],
+					 argv[3] != 0);
+		break;
+
+	case 22: // SYNC
+		sync_mapping(*arena, argv[0]);
+		break;
+
+	case 23: // FRAG
+		frag(*arena);
+		break;
+	}
+
+	// a part of the pending compaction is done after every command
+	compact_step(*arena);
+
+	return 1;
+}
+
+void free_command(command_t *cmd)
+{
+	free(cmd->argv);
+	free(cmd->data);
+	cmd->argv = NULL;
+	cmd->data = NULL;
+	cmd->argc = 0;
+	cmd->len = 0;
+}
@@ -0,0 +1,50 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include "vma.h"
+
+// a command read from the text or from the binary protocol
+typedef struct {
+	int type; // the code returned by convert()
+	long argc;
+	uint64_t *argv;
+	uint64_t len; // number of bytes of data
+	int8_t *data; // written text, permissions or options of the command
+	int checked; // the data was verified while the command was read
+} command_t;
+
+// the highest code returned by convert()
+#define COMMAND_LAST 23
+
+// the most segments of READV/WRITEV: a record of the binary protocol holds
+// at most 65535 arguments (see trace.h)
+#define COMMAND_MAX_SEGMENTS 32767
+
+// find a named arena of the server (NULL outside server mode)
+extern arena_t *(*command_named_arena)(const char *name, int *found);
+
+long command_arguments(const command_t *cmd);
+
+void read_arguments(command_t *cmd, long n);
+
+void read_options(command_t *cmd);
+
+void push_argument(command_t *cmd, uint64_t x);
+
+void read_name(command_t *cmd);
+
+segment_t *command_segments(const command_t *cmd, long *n);
+
+int command_total(const segment_t *segments, long n, uint64_t *total);
+
+int parse_command(arena_t *arena, command_t *cmd);
+
+void execute_write(arena_t *arena, command_t *cmd);
+
+void execute_write_vector(arena_t *arena, command_t *cmd);
+
+void execute_map_shared(arena_t *arena, command_t *cmd);
+
+int execute_command(arena_t **arena, command_t *cmd);
+
+void free_command(command_t *cmd);
@@ -0,0 +1,372 @@
+// COPYRIGHT: Larisa Florea
+
+// Differential fuzzer: random commands are executed by the arena and by the
+// reference model from model.c, and the output of every command must be
+// the same. Usage: ./fuzz [--big] [SEED [RUNS [COMMANDS]]]; --big uses
+// arenas of megabytes and zones up to FUZZ_BIG_SIZE, so the mmap buffers,
+// the counters of the pages and the evictions of the cache are reached.
+// Built with -DVMA_LIBFUZZER, it is a libFuzzer target that takes the
+// random choices from the input of the fuzzer instead.
+
+#define _POSIX_C_SOURCE 200809L
+#include "model.h"
+
+#define FUZZ_RUNS 1000
+#define FUZZ_COMMANDS 200
+#define FUZZ_MAX_SIZE 64
+#define FUZZ_BIG_SIZE (512 * 1024)
+// the most segments of a READV/WRITEV
+#define FUZZ_SEGMENTS 4
+
+// where the random choices come from
+typedef struct {
+	const uint8_t *bytes; // the input of libFuzzer, if any
+	size_t size, pos;
+	uint64_t state;
+} source_t;
+
+static uint64_t next(source_t *src, uint64_t n)
+{
+	uint64_t x;
+	if (src->bytes) {
+		x = 0;
+		for (int i = 0; i < 4 && src->pos < src->size; i++)
+			x = x << 8 | src->bytes[src->pos++];
+	} else {
+		src->state ^= src->state << 13;
+		src->state ^= src->state >> 7;
+		src->state ^= src->state << 17;
+		x = src->state;
+	}
+	return n ? x % n : 0;
+}
+
+static const char *names[] = {
+	"", "ALLOC_ARENA", "DEALLOC_ARENA", "ALLOC_BLOCK", "FREE_BLOCK",
+	"READ", "WRITE", "PMAP", "MPROTECT", "", "CACHE_LIMIT", "RESIZE",
+	"READV", "WRITEV"
+};
+
+static const char *permissions[] = {
+	"PROT_NONE", "PROT_READ", "PROT_WRITE", "PROT_EXEC",
+	"PROT_READ | PROT_WRITE", "PROT_READ | PROT_EXEC",
+	"PROT_READ | PROT_WRITE | PROT_EXEC", "PROT_WRITE | PROT_READ",
+	"PROT_READ | PROT_NONE | PROT_WRITE", "PROT_READ | PROT_READ"
+};
+
+// the commands of a scenario, kept to print it when the outputs differ
+typedef struct {
+	command_t *cmds;
+	long n, capacity;
+} script_t;
+
+static void set_data(command_t *cmd, const char *text, uint64_t len)
+{
+	cmd->data = malloc(len + 1);
+	if (!cmd->data)
+		return;
+	memcpy(cmd->data, text, len);
+	cmd->data[len] = '\0';
+	cmd->len = len;
+}
+
+// give a command len random letters as data
+static void random_data(source_t *src, command_t *cmd, uint64_t len)
+{
+	cmd->data = malloc(len + 1);
+	if (!cmd->data)
+		return;
+	for (uint64_t i = 0; i < len; i++)
+		cmd->data[i] = 'a' + next(src, 26);
+	cmd->data[len] = '\0';
+	cmd->len = len;
+}
+
+// pick an address, most of the times near a zone used before
+static uint64_t address(source_t *src, const uint64_t *used, long n,
+						uint64_t arena_size)
+{
+	if (n && next(src, 10) < 8) {
+		uint64_t a = used[next(src, n)];
+		uint64_t delta = next(src, 8);
+		if (next(src, 4) == 0 && a >= delta)
+			return a - delta;
+		return next(src, 2) ? a : a + delta;
+	}
+	return next(src, arena_size + 8);
+}
+
+// pick a size, most of the times a small one so the blocks have many
+// miniblocks
+static uint64_t length(source_t *src, uint64_t max_size)
+{
+	if (max_size > FUZZ_MAX_SIZE && next(src, 4) == 0)
+		return 1 + next(src, max_size);
+	return 1 + next(src, FUZZ_MAX_SIZE);
+}
+
+// pick the size of a segment: sometimes empty, past the end of the arena
+// or so big that the end of the segment wraps around
+static uint64_t segment_size(source_t *src, uint64_t arena_size,
+							 uint64_t max_size)
+{
+	switch (next(src, 16)) {
+	case 0:
+		return 0;
+	case 1:
+		return arena_size + next(src, 8);
+	case 2:
+		return UINT64_MAX - next(src, 8);
+	default:
+		return length(src, max_size);
+	}
+}
+
+static void generate(source_t *src, command_t *cmd, uint64_t arena_size,
+					 uint64_t max_size, uint64_t *used, long *n)
+{
+	static const int types[] = {3, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 8, 10,
+								11, 11, 12, 12, 13, 13};
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->type = types[next(src, sizeof(types) / sizeof(types[0]))];
+	cmd->argv = calloc(1 + 2 * FUZZ_SEGMENTS, sizeof(uint64_t));
+	if (!cmd->argv)
+		return;
+
+	uint64_t a = address(src, used, *n, arena_size);
+	uint64_t size = length(src, max_size);
+	cmd->argv[cmd->argc++] = a;
+
+	switch (cmd->type) {
+	case 3: // ALLOC_BLOCK
+		cmd->argv[cmd->argc++] = size;
+		if (*n < 64) {
+			used[(*n)++] = a;
+			used[(*n)++] = a + size;
+		} else {
+			used[next(src, *n)] = a;
+		}
+		break;
+
+	case 5: // READ
+	case 6: // WRITE
+		cmd->argv[cmd->argc++] = size;
+		if (cmd->type == 6)
+			random_data(src, cmd, size);
+		break;
+
+	case 8: { // MPROTECT
+		const char *perm = permissions[next(src, sizeof(permissions) /
+											sizeof(permissions[0]))];
+		set_data(cmd, perm, strlen(perm));
+		break;
+	}
+
+	case 10: // CACHE_LIMIT
+		cmd->argv[0] = next(src, 2 * max_size);
+		break;
+
+	case 11: // RESIZE
+		cmd->argv[cmd->argc++] = next(src, 8) ? size : 0;
+		if (next(src, 2))
+			set_data(cmd, "MOVE", 4);
+		break;
+
+	case 12: // READV
+	case 13: { // WRITEV
+		// the first argument is the number of segments
+		uint64_t count = next(src, FUZZ_SEGMENTS + 1), total = 0;
+		cmd->argv[0] = count;
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t dim = segment_size(src, arena_size, max_size);
+			cmd->argv[cmd->argc++] = i ? address(src, used, *n, arena_size)
+									   : a;
+			cmd->argv[cmd->argc++] = dim;
+			total = dim < UINT64_MAX - total ? total + dim : UINT64_MAX;
+		}
+
+		// without the data (too big to be sent), nothing may be written
+		if (cmd->type == 13 && total <= FUZZ_SEGMENTS * max_size)
+			random_data(src, cmd, total);
+		break;
+	}
+
+	case 7: // PMAP
+		cmd->argc = 0;
+		break;
+	}
+}
+
+// print a command in the text protocol, so the scenario can be replayed
+static void print_command(FILE *f, const command_t *cmd)
+{
+	fprintf(f, "%s", names[cmd->type]);
+	for (long i = 0; i < cmd->argc; i++)
+		fprintf(f, " %llu", (unsigned long long)cmd->argv[i]);
+	if (cmd->type == 6 || cmd->type == 13)
+		fprintf(f, "\n");
+	else if (cmd->data)
+		fprintf(f, " ");
+	if (cmd->data)
+		fprintf(f, "%s", (char *)cmd->data);
+	fprintf(f, "\n");
+}
+
+static command_t copy_command(const command_t *cmd)
+{
+	command_t copy = *cmd;
+	copy.argv = malloc((cmd->argc + 1) * sizeof(uint64_t));
+	if (copy.argv && cmd->argc)
+		memcpy(copy.argv, cmd->argv, cmd->argc * sizeof(uint64_t));
+	copy.data = NULL;
+	if (cmd->data)
+		set_data(&copy, (char *)cmd->data, cmd->len);
+	return copy;
+}
+
+// run a command on the arena or on the model and return its output
+static char *capture(arena_t **arena, model_t **model, command_t *cmd,
+					 size_t *len)
+{
+	char *text = NULL;
+	FILE *console = stdout;
+	stdout = open_memstream(&text, len);
+	if (!stdout) {
+		stdout = console;
+		return NULL;
+	}
+
+	// mprotect() cuts the permissions, so each side gets its own copy
+	command_t copy = copy_command(cmd);
+	if (arena)
+		execute_command(arena, &copy);
+	else
+		model_execute(model, &copy);
+	free_command(&copy);
+
+	fclose(stdout);
+	stdout = console;
+	return text;
+}
+
+static void report(uint64_t seed, const script_t *script, const char *arena,
+				   const char *model)
+{
+	fprintf(stderr, "Outputs differ (seed %llu). Commands:\n",
+			(unsigned long long)seed);
+	for (long i = 0; i < script->n; i++)
+		print_command(stderr, &script->cmds[i]);
+	fprintf(stderr, "--- arena ---\n%s--- model ---\n%s", arena, model);
+}
+
+// execute one command on both sides; return 0 if the outputs differ
+static int step(arena_t **arena, model_t **model, script_t *script,
+				command_t cmd, uint64_t seed)
+{
+	if (script->n == script->capacity) {
+		long capacity = script->capacity * 2 + 16;
+		command_t *cmds = realloc(script->cmds, capacity * sizeof(command_t));
+		if (!cmds) {
+			free_command(&cmd);
+			return 1;
+		}
+		script->cmds = cmds;
+		script->capacity = capacity;
+	}
+	script->cmds[script->n++] = cmd;
+
+	size_t len1 = 0, len2 = 0;
+	char *out1 = capture(arena, NULL, &cmd, &len1);
+	char *out2 = capture(NULL, model, &cmd, &len2);
+	int same = out1 && out2 && len1 == len2 && !memcmp(out1, out2, len1);
+	if (!same)
+		report(seed, script, out1 ? out1 : "", out2 ? out2 : "");
+
+	free(out1);
+	free(out2);
+	return same;
+}
+
+// a scenario: an arena, random commands and a final PMAP
+static int run(source_t *src, uint64_t seed, long commands, int big)
+{
+	static const uint64_t sizes[] = {64, 256, 1024, 4096};
+	static const uint64_t big_sizes[] = {1 << 20, 4 << 20, 16 << 20};
+	uint64_t max_size = big ? FUZZ_BIG_SIZE : FUZZ_MAX_SIZE;
+	arena_t *arena = NULL;
+	model_t *model = NULL;
+	script_t script = {NULL, 0, 0};
+	uint64_t used[64];
+	long n = 0;
+	int ok = 1;
+
+	command_t cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = 1;
+	cmd.argv = malloc(sizeof(uint64_t));
+	cmd.argv[cmd.argc++] = big ? big_sizes[next(src, 3)] : sizes[next(src, 4)];
+	uint64_t arena_size = cmd.argv[0];
+	ok = step(&arena, &model, &script, cmd, seed);
+
+	for (long i = 0; ok && i < commands; i++) {
+		generate(src, &cmd, arena_size, max_size, used, &n);
+		ok = step(&arena, &model, &script, cmd, seed);
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = 7;
+	if (ok)
+		ok = step(&arena, &model, &script, cmd, seed);
+	cmd.type = 2;
+	if (ok)
+		step(&arena, &model, &script, cmd, seed);
+
+	if (arena) {
+		dealloc_arena(arena);
+		free(arena);
+	}
+	if (model)
+		model_dealloc_arena(model);
+	for (long i = 0; i < script.n; i++)
+		free_command(&script.cmds[i]);
+	free(script.cmds);
+	return ok;
+}
+
+#ifdef VMA_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	source_t src = {data, size, 0, 0};
+	int big = next(&src, 8) == 0;
+	if (!run(&src, 0, size / 8, big))
+		abort();
+	return 0;
+}
+#else
+int main(int argc, char *argv[])
+{
+	unsigned long long seed = 1, runs = FUZZ_RUNS, commands = FUZZ_COMMANDS;
+	int big = argc > 1 && strcmp(argv[1], "--big") == 0;
+	if (big) {
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		seed = strtoull(argv[1], NULL, 10);
+	if (argc > 2)
+		runs = strtoull(argv[2], NULL, 10);
+	if (argc > 3)
+		commands = strtoull(argv[3], NULL, 10);
+
+	for (unsigned long long i = 0; i < runs; i++) {
+		source_t src = {NULL, 0, 0, (seed + i) * 0x9E3779B97F4A7C15ULL};
+		if (!src.state)
+			src.state = 1;
+		if (!run(&src, seed + i, commands, big))
+			return 1;
+	}
+
+	printf("%llu runs passed\n", runs);
+	return 0;
+}
+#endif
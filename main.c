@@ -1,72 +1,85 @@
 // COPYRIGHT: Larisa Florea
 
-#include "vma.h"
+#include "trace.h"
+#include "server.h"
 
-int main(void)
+int main(int argc, char *argv[])
 {
-	char command[50];
-	int exit = 1;
-	unsigned long long size, a, b;
+	int exit = 1, timestamps = 0, timed = 0, threads = 0;
 	arena_t *arena = NULL;
-	int8_t *data = NULL, permission[200];
+	command_t cmd;
+	FILE *record = NULL, *replay = NULL;
+	const char *server = NULL, *remote = NULL;
 
-	while (exit) {
-		scanf("%s", command);
-
-		switch (convert(command)) {
-		case 1: // ALLOC_ARENA
-			scanf("%llu", &size);
-			arena = alloc_arena(size);
-			break;
-
-		case 2: // DEALLOC_ARENA
-			dealloc_arena(arena);
-			free(arena);
-			exit = 0;
-			break;
-
-		case 3: // ALLOC_BLOCK
-			scanf("%llu%llu", &a, &b);
-			alloc_block(arena, a, b);
-			break;
+	// ----------------------- Options -----------------------
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			record = fopen(argv[++i], "wb");
+			if (!record) {
+				fprintf(stderr, "Could not open %s\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "-") == 0)
+				replay = stdin;
+			else
+				replay = fopen(argv[i], "rb");
+			if (!replay) {
+				fprintf(stderr, "Could not open %s\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+			server = argv[++i];
+		} else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+			remote = argv[++i];
+		} else if (strcmp(argv[i], "--reclaim") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--timestamps") == 0) {
+			timestamps = 1;
+		} else if (strcmp(argv[i], "--timed") == 0) {
+			timed = 1;
+		} else {
+			fprintf(stderr, "Usage: %s [--record FILE [--timestamps]] ", argv[0]);
+			fprintf(stderr, "[--replay FILE [--timed]] ");
+			fprintf(stderr, "[--serve SOCKET] [--client SOCKET] ");
+			fprintf(stderr, "[--reclaim THREADS]\n");
+			return 1;
+		}
+	}
 
-		case 4: // FREE_BLOCK
-			scanf("%llu", &a);
-			free_block(arena, a);
-			break;
+	if (remote)
+		return client(remote);
 
-		case 5: // READ
-			scanf("%llu%llu", &a, &b);
-			read(arena, a, b);
-			break;
+	// the freed buffers are released in the background
+	if (threads > 0 && !reclaim_start(threads, RECLAIM_MAX_BYTES))
+		fprintf(stderr, "The reclamation threads could not be started\n");
 
-		case 6: // WRITE
-			scanf("%llu%llu", &a, &b);
-			data = text(arena, a, b);
-			if (data)
-				b = strlen((char *)data);
-			write(arena, a, b, data);
-			if (data)
-				free(data);
-			break;
+	if (server)
+		return serve(server);
 
-		case 7: // PMAP
-			pmap(arena);
-			break;
+	// the commands of a binary trace
+	if (replay) {
+		replay_trace(replay, timed);
+		if (replay != stdin)
+			fclose(replay);
+		reclaim_stop();
+		return 0;
+	}
 
-		case 8: // MPROTECT
-			scanf("%llu", &a);
-			scanf("%[^\n]", permission);
-			mprotect(arena, a, permission);
-			break;
+	// the commands of the text protocol
+	uint64_t start = trace_clock();
+	while (exit && parse_command(arena, &cmd)) {
+		if (record)
+			trace_write(record, &cmd, timestamps, trace_clock() - start);
 
-		default: // INVALID COMMAND
-			printf("Invalid command. Please try again.\n");
-			break;
-		}
-		getchar();
+		exit = execute_command(&arena, &cmd);
+		free_command(&cmd);
 	}
 
+	if (record)
+		fclose(record);
+	reclaim_stop();
+
 	return 0;
 }
-
@@ -0,0 +1,495 @@
+// COPYRIGHT: Larisa Florea
+
+#include "model.h"
+
+model_t *model_alloc_arena(uint64_t size)
+{
+	model_t *model = calloc(1, sizeof(*model));
+	if (!model) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return NULL;
+	}
+	model->arena_size = size;
+	return model;
+}
+
+void model_dealloc_arena(model_t *model)
+{
+	for (long i = 0; i < model->n; i++)
+		free(model->zones[i].data);
+	free(model->zones);
+	free(model);
+}
+
+static uint64_t zone_end(const model_zone_t *zone)
+{
+	return zone->start_address + zone->size;
+}
+
+// return the zone that holds an address, or -1
+static long find_zone(const model_t *model, uint64_t address)
+{
+	for (long i = 0; i < model->n; i++)
+		if (address >= model->zones[i].start_address &&
+			address < zone_end(&model->zones[i]))
+			return i;
+	return -1;
+}
+
+// return the zone that starts at an address, or -1
+static long find_start(const model_t *model, uint64_t address)
+{
+	for (long i = 0; i < model->n; i++)
+		if (model->zones[i].start_address == address)
+			return i;
+	return -1;
+}
+
+// return the last zone of the block that holds the zone i
+static long block_last(const model_t *model, long i)
+{
+	while (i + 1 < model->n &&
+		   zone_end(&model->zones[i]) == model->zones[i + 1].start_address)
+		i++;
+	return i;
+}
+
+static void insert_zone(model_t *model, model_zone_t zone)
+{
+	if (model->n == model->capacity) {
+		long capacity = model->capacity * 2 + 8;
+		model_zone_t *zones = realloc(model->zones,
+									  capacity * sizeof(model_zone_t));
+		if (!zones) {
+			fprintf(stderr, "This zone could not be allocated\n");
+			free(zone.data);
+			return;
+		}
+		model->zones = zones;
+		model->capacity = capacity;
+	}
+
+	long i = model->n;
+	while (i > 0 && model->zones[i - 1].start_address > zone.start_address) {
+		model->zones[i] = model->zones[i - 1];
+		i--;
+	}
+	model->zones[i] = zone;
+	model->n++;
+}
+
+static void remove_zone(model_t *model, long i)
+{
+	free(model->zones[i].data);
+	for (long j = i; j + 1 < model->n; j++)
+		model->zones[j] = model->zones[j + 1];
+	model->n--;
+}
+
+// return 1 if no zone overlaps [address, address + size)
+static int is_free(const model_t *model, uint64_t address, uint64_t size)
+{
+	for (long i = 0; i < model->n; i++)
+		if (address < zone_end(&model->zones[i]) &&
+			model->zones[i].start_address < address + size)
+			return 0;
+	return 1;
+}
+
+void model_alloc_block(model_t *model, uint64_t address, uint64_t size)
+{
+	if (address >= model->arena_size) {
+		printf("The allocated address is outside the size of arena\n");
+		return;
+	}
+	if (address + size > model->arena_size) {
+		printf("The end address is past the size of the arena\n");
+		return;
+	}
+	if (!is_free(model, address, size)) {
+		printf("This zone was already allocated.\n");
+		return;
+	}
+
+	model_zone_t zone = {address, size, 6, calloc(size + 1, 1)};
+	insert_zone(model, zone);
+}
+
+void model_free_block(model_t *model, uint64_t address)
+{
+	long i = find_start(model, address);
+	if (i < 0) {
+		printf("Invalid address for free.\n");
+		return;
+	}
+	remove_zone(model, i);
+}
+
+// find the zone of an access, verify the permissions of every zone it
+// touches and return the number of bytes that fit in the block, or -1
+static long long check_access(const model_t *model, uint64_t address,
+							  uint64_t size, uint8_t mask, const char *name)
+{
+	long i = find_zone(model, address);
+	if (i < 0) {
+		printf("Invalid address for %s.\n", name);
+		return -1;
+	}
+
+	uint64_t available = zone_end(&model->zones[block_last(model, i)]) -
+						 address;
+	uint64_t n = size < available ? size : available;
+
+	// the zone of the address is always checked, even for 0 bytes
+	for (long j = i; j < model->n; j++) {
+		if (j > i && model->zones[j].start_address >= address + n)
+			break;
+		if (!(model->zones[j].perm & mask)) {
+			printf("Invalid permissions for %s.\n", name);
+			return -1;
+		}
+	}
+
+	if (available < size) {
+		printf("Warning: size was bigger than the block size. ");
+		printf("%s %lu characters.\n", mask == 4 ? "Reading" : "Writing",
+			   available);
+	}
+	return n;
+}
+
+void model_read(model_t *model, uint64_t address, uint64_t size)
+{
+	long long n = check_access(model, address, size, 4, "read");
+	if (n < 0)
+		return;
+
+	for (long i = find_zone(model, address); n > 0; i++) {
+		model_zone_t *zone = &model->zones[i];
+		for (uint64_t a = address; a < zone_end(zone) && n > 0; a++, n--)
+			putchar(zone->data[a - zone->start_address]);
+		address = zone_end(zone);
+	}
+	printf("\n");
+}
+
+void model_write(model_t *model, uint64_t address, uint64_t size,
+				 const int8_t *data)
+{
+	long long n = check_access(model, address, size, 2, "write");
+	if (n < 0)
+		return;
+
+	for (long i = find_zone(model, address); n > 0; i++) {
+		model_zone_t *zone = &model->zones[i];
+		for (uint64_t a = address; a < zone_end(zone) && n > 0; a++, n--)
+			zone->data[a - zone->start_address] = *data++;
+		address = zone_end(zone);
+	}
+}
+
+// verify the segments of a vectored command in the order of their
+// addresses, like resolve_segments; return 0 on success, 1 for an invalid
+// address and 2 for a permission that is missing
+static int check_segments(const model_t *model, const uint64_t *argv, long n,
+						  uint8_t mask)
+{
+	// the segments at the same address keep the order of the command
+	long *order = malloc((n + 1) * sizeof(long));
+	if (!order) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return 1;
+	}
+	for (long k = 0; k < n; k++) {
+		long j = k;
+		while (j > 0 && argv[1 + 2 * order[j - 1]] > argv[1 + 2 * k]) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = k;
+	}
+
+	int ret = 0;
+	for (long k = 0; !ret && k < n; k++) {
+		uint64_t address = argv[1 + 2 * order[k]];
+		uint64_t size = argv[2 + 2 * order[k]];
+		long i = find_zone(model, address);
+		if (i < 0 ||
+			size > zone_end(&model->zones[block_last(model, i)]) - address) {
+			ret = 1;
+			break;
+		}
+
+		// the zone of the address is always checked, even for 0 bytes
+		for (long j = i; j < model->n; j++) {
+			if (j > i && model->zones[j].start_address >= address + size)
+				break;
+			if (!(model->zones[j].perm & mask))
+				ret = 2;
+		}
+	}
+
+	free(order);
+	return ret;
+}
+
+void model_read_vector(model_t *model, const uint64_t *argv, long n)
+{
+	int ret = check_segments(model, argv, n, 4);
+	if (ret) {
+		printf("Invalid %s for readv.\n",
+			   ret == 1 ? "address" : "permissions");
+		return;
+	}
+
+	for (long k = 0; k < n; k++) {
+		uint64_t address = argv[1 + 2 * k], size = argv[2 + 2 * k];
+		for (long i = find_zone(model, address); size > 0; i++) {
+			model_zone_t *zone = &model->zones[i];
+			for (; address < zone_end(zone) && size > 0; address++, size--)
+				putchar(zone->data[address - zone->start_address]);
+		}
+		printf("\n");
+	}
+}
+
+void model_write_vector(model_t *model, const uint64_t *argv, long n,
+						const int8_t *data, uint64_t len)
+{
+	int ret = check_segments(model, argv, n, 2);
+	if (ret) {
+		printf("Invalid %s for writev.\n",
+			   ret == 1 ? "address" : "permissions");
+		return;
+	}
+
+	// the data must be complete
+	uint64_t total = 0;
+	for (long k = 0; k < n; k++)
+		total += argv[2 + 2 * k];
+	if (!data || len < total)
+		return;
+
+	for (long k = 0; k < n; k++) {
+		uint64_t address = argv[1 + 2 * k], size = argv[2 + 2 * k];
+		for (long i = find_zone(model, address); size > 0; i++) {
+			model_zone_t *zone = &model->zones[i];
+			for (; address < zone_end(zone) && size > 0; address++, size--)
+				zone->data[address - zone->start_address] = *data++;
+		}
+	}
+}
+
+void model_mprotect(model_t *model, uint64_t address, const char *permission)
+{
+	long i = find_start(model, address);
+	if (i < 0) {
+		printf("Invalid address for mprotect.\n");
+		return;
+	}
+
+	// PROT_NONE clears the flags named before it
+	uint8_t perm = 0;
+	const char *p = permission;
+	while (*p) {
+		if (strncmp(p, "PROT_NONE", 9) == 0)
+			perm = 0;
+		else if (strncmp(p, "PROT_READ", 9) == 0)
+			perm |= 4;
+		else if (strncmp(p, "PROT_WRITE", 10) == 0)
+			perm |= 2;
+		else if (strncmp(p, "PROT_EXEC", 9) == 0)
+			perm |= 1;
+		while (*p && *p != ' ' && *p != '|')
+			p++;
+		while (*p == ' ' || *p == '|')
+			p++;
+	}
+	model->zones[i].perm = perm;
+}
+
+void model_resize(model_t *model, uint64_t address, uint64_t new_size,
+				  int move)
+{
+	long i = find_start(model, address);
+	if (i < 0) {
+		printf("Invalid address for resize.\n");
+		return;
+	}
+	if (new_size == 0) {
+		printf("Invalid size for resize.\n");
+		return;
+	}
+
+	model_zone_t *zone = &model->zones[i];
+	if (new_size == zone->size)
+		return;
+
+	int8_t *data = calloc(new_size + 1, 1);
+	if (!data) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+	memcpy(data, zone->data, new_size < zone->size ? new_size : zone->size);
+
+	// only the last miniblock of a block grows in place
+	uint64_t end = address + new_size;
+	int in_place = block_last(model, i) == i && end <= model->arena_size;
+	if (i + 1 < model->n && end > model->zones[i + 1].start_address)
+		in_place = 0;
+	if (new_size < zone->size || in_place) {
+		free(zone->data);
+		zone->data = data;
+		zone->size = new_size;
+		return;
+	}
+
+	if (!move) {
+		free(data);
+		if (end > model->arena_size)
+			printf("The end address is past the size of the arena\n");
+		else
+			printf("This zone was already allocated.\n");
+		return;
+	}
+
+	// the first free zone that is big enough, the old one still counts
+	uint64_t free_start = 0;
+	long j;
+	for (j = 0; j < model->n; j++) {
+		if (model->zones[j].start_address - free_start >= new_size)
+			break;
+		free_start = zone_end(&model->zones[j]);
+	}
+	if (j == model->n && (free_start > model->arena_size ||
+						  model->arena_size - free_start < new_size)) {
+		free(data);
+		printf("Not enough space to resize.\n");
+		return;
+	}
+
+	model_zone_t moved = {free_start, new_size, zone->perm, data};
+	remove_zone(model, i);
+	insert_zone(model, moved);
+	printf("Miniblock moved to 0x%llX.\n", (unsigned long long)free_start);
+}
+
+static void model_perm(uint8_t perm)
+{
+	printf("%c%c%c\n", perm & 4 ? 'R' : '-', perm & 2 ? 'W' : '-',
+		   perm & 1 ? 'X' : '-');
+}
+
+void model_pmap(const model_t *model)
+{
+	uint64_t allocated = 0, blocks = 0;
+	for (long i = 0; i < model->n; i++) {
+		allocated += model->zones[i].size;
+		if (i == 0 || zone_end(&model->zones[i - 1]) !=
+			model->zones[i].start_address)
+			blocks++;
+	}
+
+	printf("Total memory: 0x%llX bytes\n",
+		   (unsigned long long)model->arena_size);
+	printf("Free memory: 0x%llX bytes\n",
+		   (unsigned long long)(model->arena_size - allocated));
+	printf("Number of allocated blocks: %llu\n", (unsigned long long)blocks);
+	printf("Number of allocated miniblocks: %llu\n",
+		   (unsigned long long)model->n);
+
+	unsigned long long block = 0;
+	for (long i = 0; i < model->n; i++) {
+		long last = block_last(model, i);
+		block++;
+		printf("\nBlock %llu begin\n", block);
+		printf("Zone: 0x%llX - 0x%llX\n",
+			   (unsigned long long)model->zones[i].start_address,
+			   (unsigned long long)zone_end(&model->zones[last]));
+		for (long j = i; j <= last; j++) {
+			printf("Miniblock %ld:", j - i + 1);
+			printf("\t\t0x%llX\t\t-\t\t0x%llX\t\t| ",
+				   (unsigned long long)model->zones[j].start_address,
+				   (unsigned long long)zone_end(&model->zones[j]));
+			model_perm(model->zones[j].perm);
+		}
+		printf("Block %llu end\n", block);
+		i = last;
+	}
+}
+
+// execute the commands the model knows, like execute_command
+int model_execute(model_t **model, const command_t *cmd)
+{
+	const uint64_t *argv = cmd->argv;
+
+	if (cmd->type < 0 || cmd->argc < command_arguments(cmd)) {
+		printf("Invalid command. Please try again.\n");
+		return 1;
+	}
+
+	if (!*model && cmd->type != 1) {
+		printf("The arena was not allocated.\n");
+		return cmd->type != 2;
+	}
+
+	switch (cmd->type) {
+	case 1: // ALLOC_ARENA
+		if (*model) {
+			printf("The arena was already allocated.\n");
+			break;
+		}
+		*model = model_alloc_arena(argv[0]);
+		break;
+
+	case 2: // DEALLOC_ARENA
+		model_dealloc_arena(*model);
+		*model = NULL;
+		return 0;
+
+	case 3: // ALLOC_BLOCK
+		model_alloc_block(*model, argv[0], argv[1]);
+		break;
+
+	case 4: // FREE_BLOCK
+		model_free_block(*model, argv[0]);
+		break;
+
+	case 5: // READ
+		model_read(*model, argv[0], argv[1]);
+		break;
+
+	case 6: // WRITE (the data must be complete)
+		if (cmd->data && cmd->len >= argv[1])
+			model_write(*model, argv[0], argv[1], cmd->data);
+		break;
+
+	case 7: // PMAP
+		model_pmap(*model);
+		break;
+
+	case 8: // MPROTECT
+		if (cmd->data)
+			model_mprotect(*model, argv[0], (const char *)cmd->data);
+		break;
+
+	case 10: // CACHE_LIMIT (the model has no cache)
+		break;
+
+	case 11: // RESIZE
+		model_resize(*model, argv[0], argv[1],
+					 cmd->data && strstr((const char *)cmd->data, "MOVE"));
+		break;
+
+	case 12: // READV
+		model_read_vector(*model, argv, (cmd->argc - 1) / 2);
+		break;
+
+	case 13: // WRITEV
+		model_write_vector(*model, argv, (cmd->argc - 1) / 2, cmd->data,
+						   cmd->len);
+		break;
+	}
+
+	return 1;
+}
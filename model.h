@@ -0,0 +1,48 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include "command.h"
+
+// A reference implementation of the arena, used by the fuzzer to check the
+// real one. It is written to be obviously correct instead of fast: the
+// miniblocks are kept in an array sorted by address and the blocks are not
+// stored at all, they are found each time as runs of adjacent miniblocks.
+typedef struct {
+	uint64_t start_address;
+	uint64_t size;
+	uint8_t perm;
+	int8_t *data;
+} model_zone_t;
+
+typedef struct {
+	uint64_t arena_size;
+	model_zone_t *zones;
+	long n, capacity;
+} model_t;
+
+model_t *model_alloc_arena(uint64_t size);
+
+void model_dealloc_arena(model_t *model);
+
+void model_alloc_block(model_t *model, uint64_t address, uint64_t size);
+
+void model_free_block(model_t *model, uint64_t address);
+
+void model_read(model_t *model, uint64_t address, uint64_t size);
+
+void model_write(model_t *model, uint64_t address, uint64_t size,
+				 const int8_t *data);
+
+void model_read_vector(model_t *model, const uint64_t *argv, long n);
+
+void model_write_vector(model_t *model, const uint64_t *argv, long n,
+						const int8_t *data, uint64_t len);
+
+void model_mprotect(model_t *model, uint64_t address, const char *permission);
+
+void model_resize(model_t *model, uint64_t address, uint64_t new_size,
+				  int move);
+
+void model_pmap(const model_t *model);
+
+int model_execute(model_t **model, const command_t *cmd);
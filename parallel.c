@@ -0,0 +1,116 @@
+// COPYRIGHT: Larisa Florea
+
+// Output formatted on several threads: every chunk is written by its own
+// thread into its own buffer, then the buffers are printed in order.
+
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "parallel.h"
+
+typedef struct {
+	pthread_t thread;
+	parallel_format_t format;
+	const void *chunk;
+	char *text;
+	size_t len;
+	int ok;
+} worker_t;
+
+static void *format_chunk(void *arg)
+{
+	worker_t *worker = arg;
+	FILE *out = open_memstream(&worker->text, &worker->len);
+	if (!out)
+		return NULL;
+
+	worker->format(out, worker->chunk);
+	worker->ok = fclose(out) == 0;
+	return NULL;
+}
+
+// the number of threads worth using on this machine
+int parallel_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	if (n > PARALLEL_MAX_THREADS)
+		return PARALLEL_MAX_THREADS;
+	return (int)n;
+}
+
+// write the buffers to a file descriptor with as few calls as possible
+static int write_all(int fd, struct iovec *iov, int n)
+{
+	while (n) {
+		ssize_t written = writev(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0)
+			return 0;
+
+		// skip what was written, the rest is written again
+		while (n && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return 1;
+}
+
+// format n chunks (of chunk_size bytes each) in parallel and print them in
+// order; return 0, without printing anything, if it could not be done
+int parallel_print(parallel_format_t format, const void *chunks,
+				   size_t chunk_size, int n)
+{
+	worker_t *workers = calloc(n, sizeof(worker_t));
+	struct iovec *iov = calloc(n, sizeof(struct iovec));
+	int started = 0, ok = workers && iov;
+
+	for (; ok && started < n; started++) {
+		workers[started].format = format;
+		workers[started].chunk = (const char *)chunks + started * chunk_size;
+		if (pthread_create(&workers[started].thread, NULL, format_chunk,
+						   &workers[started]))
+			break;
+	}
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ok = ok && workers[i].ok;
+	}
+	ok = ok && started == n;
+
+	if (ok) {
+		for (int i = 0; i < n; i++) {
+			iov[i].iov_base = workers[i].text;
+			iov[i].iov_len = workers[i].len;
+		}
+
+		// what was printed before must come first; when the output is
+		// captured in memory (server mode), there is no descriptor
+		fflush(stdout);
+		int fd = fileno(stdout);
+		if (fd >= 0)
+			write_all(fd, iov, n);
+		else
+			for (int i = 0; i < n; i++)
+				fwrite(workers[i].text, 1, workers[i].len, stdout);
+	}
+
+	for (int i = 0; i < started; i++)
+		free(workers[i].text);
+	free(workers);
+	free(iov);
+	return ok;
+}
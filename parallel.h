@@ -0,0 +1,15 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include <stdio.h>
+
+// the most threads that format the output of a command
+#define PARALLEL_MAX_THREADS 8
+
+// write the text of a chunk to out
+typedef void (*parallel_format_t)(FILE *out, const void *chunk);
+
+int parallel_threads(void);
+
+int parallel_print(parallel_format_t format, const void *chunks,
+				   size_t chunk_size, int n);
@@ -0,0 +1,32 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+
+// The data structures of the allocator are chosen at compile time, so a
+// build for a given workload has no run-time dispatch. Each policy is
+// selected with a -D flag (see POLICY in the Makefile); the defaults
+// give the original behaviour.
+
+// VMA_INDEX: how search_block finds the block that holds an address
+#define VMA_INDEX_LIST 0 // walk the blocks from the head of the arena
+#define VMA_INDEX_CURSOR 1 // start from the last block that was found
+
+// VMA_STORAGE: where the buffers of the miniblocks come from
+#define VMA_STORAGE_CACHE 0 // the size-class cache of the arena
+#define VMA_STORAGE_DIRECT 1 // malloc/mmap, released as soon as they are freed
+
+// VMA_META: how the blocks and miniblocks themselves are allocated
+#define VMA_META_MALLOC 0 // one malloc for each of them
+#define VMA_META_POOL 1 // slabs of the arena, released all at once
+
+#ifndef VMA_INDEX
+#define VMA_INDEX VMA_INDEX_LIST
+#endif
+
+#ifndef VMA_STORAGE
+#define VMA_STORAGE VMA_STORAGE_CACHE
+#endif
+
+#ifndef VMA_META
+#define VMA_META VMA_META_MALLOC
+#endif
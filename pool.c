@@ -0,0 +1,81 @@
+// COPYRIGHT: Larisa Florea
+
+#include <stdlib.h>
+#include "pool.h"
+
+// the header of a slab, followed by POOL_SLAB objects
+typedef union slab_t {
+	union slab_t *next;
+	long double align; // the objects after it stay aligned
+} slab_t;
+
+void pool_init(pool_t *pool, size_t size)
+{
+	// an object must be able to hold the link of the free list
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	pool->size = size;
+	pool->free_list = NULL;
+	pool->slabs = NULL;
+	pool->objects = 0;
+	pool->capacity = 0;
+}
+
+// release every slab, together with the objects still in use
+void pool_destroy(pool_t *pool)
+{
+	slab_t *curr = pool->slabs;
+	while (curr) {
+		slab_t *next = curr->next;
+		free(curr);
+		curr = next;
+	}
+	pool->free_list = NULL;
+	pool->slabs = NULL;
+	pool->objects = 0;
+	pool->capacity = 0;
+}
+
+// add a new slab and put its objects in the free list
+static int pool_grow(pool_t *pool)
+{
+	slab_t *slab = malloc(sizeof(slab_t) + POOL_SLAB * pool->size);
+	if (!slab)
+		return 0;
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->capacity += POOL_SLAB;
+
+	// the objects are linked in order, so they are used in order
+	char *objects = (char *)(slab + 1);
+	for (int i = POOL_SLAB - 1; i >= 0; i--) {
+		void **object = (void **)(objects + i * pool->size);
+		*object = pool->free_list;
+		pool->free_list = object;
+	}
+
+	return 1;
+}
+
+void *pool_alloc(pool_t *pool)
+{
+	if (!pool->free_list && !pool_grow(pool))
+		return NULL;
+
+	void **object = pool->free_list;
+	pool->free_list = *object;
+	pool->objects++;
+	return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	if (!object)
+		return;
+
+	*(void **)object = pool->free_list;
+	pool->free_list = object;
+	pool->objects--;
+}
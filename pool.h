@@ -0,0 +1,25 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// number of objects allocated together in a slab
+#define POOL_SLAB 64
+
+// a pool of objects of the same size, taken from slabs
+typedef struct {
+	size_t size; // the size of an object
+	void *free_list; // freed objects, linked through their first bytes
+	void *slabs; // every slab starts with a link to the next one
+	uint64_t objects; // number of objects in use
+	uint64_t capacity; // number of objects of all the slabs
+} pool_t;
+
+void pool_init(pool_t *pool, size_t size);
+
+void pool_destroy(pool_t *pool);
+
+void *pool_alloc(pool_t *pool);
+
+void pool_free(pool_t *pool, void *object);
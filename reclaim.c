@@ -0,0 +1,180 @@
+// COPYRIGHT: Larisa Florea
+
+// Background reclamation: the buffers (and, on teardown, the metadata) that
+// are freed are unlinked at once but released by worker threads, so a big
+// FREE_BLOCK or DEALLOC_ARENA does not stall the commands that follow it.
+// Without workers, everything is released immediately.
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "buffer.h"
+#include "reclaim.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+static pthread_t *workers;
+static int nr_workers, stopping;
+static reclaim_batch_t queue;
+static uint64_t max_queued;
+
+// the bytes that a zone really holds
+static uint64_t zone_bytes(const reclaim_node_t *node)
+{
+	if (!node->size)
+		return sizeof(reclaim_node_t);
+	return buffer_capacity(node->size);
+}
+
+static void release_nodes(reclaim_node_t *node)
+{
+	while (node) {
+		reclaim_node_t *next = node->next;
+		if (node->size)
+			buffer_release(node, node->size);
+		else
+			free(node);
+		node = next;
+	}
+}
+
+static void *reclaim_worker(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	while (1) {
+		while (!queue.head && !stopping)
+			pthread_cond_wait(&ready, &lock);
+		if (!queue.head)
+			break;
+
+		// take a batch, so the other workers can take the next ones
+		reclaim_node_t *head = queue.head, *last = head;
+		uint64_t bytes = zone_bytes(head);
+		for (long i = 1; i < RECLAIM_BATCH && last->next; i++) {
+			last = last->next;
+			bytes += zone_bytes(last);
+		}
+		queue.head = last->next;
+		if (!queue.head)
+			queue.tail = NULL;
+		last->next = NULL;
+		queue.bytes -= bytes;
+		pthread_mutex_unlock(&lock);
+
+		release_nodes(head);
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+// start the workers; the queue keeps at most max_bytes
+int reclaim_start(int threads, uint64_t max_bytes)
+{
+	if (threads <= 0 || workers)
+		return 0;
+
+	workers = malloc(threads * sizeof(pthread_t));
+	if (!workers)
+		return 0;
+
+	max_queued = max_bytes;
+	stopping = 0;
+	for (nr_workers = 0; nr_workers < threads; nr_workers++)
+		if (pthread_create(&workers[nr_workers], NULL, reclaim_worker, NULL))
+			break;
+
+	if (!nr_workers) {
+		free(workers);
+		workers = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+// release everything that is queued and stop the workers
+void reclaim_stop(void)
+{
+	if (!workers)
+		return;
+
+	pthread_mutex_lock(&lock);
+	stopping = 1;
+	pthread_cond_broadcast(&ready);
+	pthread_mutex_unlock(&lock);
+
+	for (int i = 0; i < nr_workers; i++)
+		pthread_join(workers[i], NULL);
+	free(workers);
+	workers = NULL;
+	nr_workers = 0;
+}
+
+// return 1 if the freed memory is released by worker threads
+int reclaim_active(void)
+{
+	return workers != NULL;
+}
+
+// add a zone to a batch; size is the size of a buffer of buffer.c, or 0
+// for memory from malloc
+void reclaim_add(reclaim_batch_t *batch, void *zone, size_t size)
+{
+	if (!zone)
+		return;
+
+	reclaim_node_t *node = zone;
+	node->next = NULL;
+	node->size = size;
+	if (batch->tail)
+		batch->tail->next = node;
+	else
+		batch->head = node;
+	batch->tail = node;
+	batch->count++;
+	batch->bytes += zone_bytes(node);
+
+	if (batch->count == RECLAIM_BATCH)
+		reclaim_flush(batch);
+}
+
+// hand a batch to the workers; without workers, or if the queue is full,
+// the caller releases it
+void reclaim_flush(reclaim_batch_t *batch)
+{
+	if (!batch->head)
+		return;
+
+	int queued = 0;
+	if (workers) {
+		pthread_mutex_lock(&lock);
+		if (queue.bytes + batch->bytes <= max_queued) {
+			if (queue.tail)
+				queue.tail->next = batch->head;
+			else
+				queue.head = batch->head;
+			queue.tail = batch->tail;
+			queue.bytes += batch->bytes;
+			queued = 1;
+			pthread_cond_signal(&ready);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	if (!queued)
+		release_nodes(batch->head);
+	batch->head = NULL;
+	batch->tail = NULL;
+	batch->count = 0;
+	batch->bytes = 0;
+}
+
+// release a buffer of buffer.c in the background
+void reclaim_buffer(void *buffer, size_t size)
+{
+	reclaim_batch_t batch = {NULL, NULL, 0, 0};
+	reclaim_add(&batch, buffer, size);
+	reclaim_flush(&batch);
+}
@@ -0,0 +1,37 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// the freed memory is handed to the workers in batches of this many zones
+#define RECLAIM_BATCH 64
+
+// default limit for the bytes that wait in the queue; past it, the
+// memory is released by the caller instead
+#define RECLAIM_MAX_BYTES (256ULL * 1024 * 1024)
+
+// header written over the first bytes of a zone while it waits
+typedef struct reclaim_node_t {
+	struct reclaim_node_t *next;
+	size_t size; // the size of a buffer, 0 for memory from malloc
+} reclaim_node_t;
+
+// zones gathered by a thread before they are handed over together
+typedef struct {
+	reclaim_node_t *head, *tail;
+	long count;
+	uint64_t bytes;
+} reclaim_batch_t;
+
+int reclaim_start(int threads, uint64_t max_bytes);
+
+void reclaim_stop(void);
+
+int reclaim_active(void);
+
+void reclaim_add(reclaim_batch_t *batch, void *zone, size_t size);
+
+void reclaim_flush(reclaim_batch_t *batch);
+
+void reclaim_buffer(void *buffer, size_t size);
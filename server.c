@@ -0,0 +1,320 @@
+// COPYRIGHT: Larisa Florea
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+
+// a connection and the bytes that wait to be executed or sent
+typedef struct {
+	int fd;
+	session_t *session;
+	uint8_t *in;
+	size_t in_len, in_cap;
+	uint8_t *out;
+	size_t out_len, out_sent;
+	int closing; // the client will not send anything else
+	int paused; // too much output waits, the commands are not executed
+} connection_t;
+
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int open_socket(const char *path, struct sockaddr_un *addr)
+{
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "The socket path is too long\n");
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+static void close_connection(int epfd, connection_t *conn)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	session_close(conn->session);
+	free(conn->in);
+	free(conn->out);
+	free(conn);
+}
+
+// send as much of the pending output as the socket accepts;
+// return 1 when everything was sent and -1 on errors
+static int flush_output(int epfd, connection_t *conn)
+{
+	while (conn->out_sent < conn->out_len) {
+		ssize_t n = send(conn->fd, conn->out + conn->out_sent,
+						 conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			// the rest is sent when the socket becomes writable; a paused
+			// client is not read until then
+			struct epoll_event ev = {0};
+			ev.events = conn->paused ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+			ev.data.ptr = conn;
+			epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+			return 0;
+		}
+		if (n < 0)
+			return -1;
+		conn->out_sent += n;
+	}
+
+	free(conn->out);
+	conn->out = NULL;
+	conn->out_len = 0;
+	conn->out_sent = 0;
+
+	struct epoll_event ev = {0};
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+	return 1;
+}
+
+// execute the complete commands of the client and read what it sends,
+// while its output does not pile up; return -1 if the connection must be
+// closed
+static int handle_input(int epfd, connection_t *conn)
+{
+	while (1) {
+		// the responses of all the commands are sent together
+		long used = session_feed(conn->session, conn->in, conn->in_len,
+								 &conn->out, &conn->out_len,
+								 conn->out_sent + SERVER_MAX_OUTPUT);
+		if (used < 0)
+			return -1;
+		memmove(conn->in, conn->in + used, conn->in_len - used);
+		conn->in_len -= used;
+
+		// nothing more is read until the client takes its responses
+		conn->paused = conn->out_len - conn->out_sent >= SERVER_MAX_OUTPUT;
+		if (conn->paused || conn->closing)
+			break;
+
+		// the record that is not complete yet is too big to be kept
+		if (conn->in_len >= SERVER_MAX_INPUT)
+			return -1;
+
+		if (conn->in_cap - conn->in_len < SERVER_READ_SIZE &&
+			conn->in_cap < SERVER_MAX_INPUT) {
+			size_t cap = conn->in_cap * 2 + SERVER_READ_SIZE;
+			if (cap > SERVER_MAX_INPUT)
+				cap = SERVER_MAX_INPUT;
+			uint8_t *in = realloc(conn->in, cap);
+			if (!in)
+				return -1;
+			conn->in = in;
+			conn->in_cap = cap;
+		}
+
+		ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+						 conn->in_cap - conn->in_len, 0);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			conn->closing = 1;
+		conn->in_len += n;
+	}
+
+	int ret = flush_output(epfd, conn);
+	if (ret < 0 || (ret > 0 && conn->closing && !conn->paused))
+		return -1;
+	return 0;
+}
+
+// accept clients on a unix socket and execute their commands, each one
+// with its own arena, until the process is stopped
+int serve(const char *path)
+{
+	struct sockaddr_un addr;
+	int lfd = open_socket(path, &addr);
+	if (lfd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	// only a socket left by a previous server is replaced
+	struct stat st;
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "The socket path is used by another file\n");
+			close(lfd);
+			return 1;
+		}
+		unlink(path);
+	}
+
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(lfd, SOMAXCONN) < 0 || set_nonblocking(lfd) < 0) {
+		perror("bind");
+		close(lfd);
+		return 1;
+	}
+
+	int epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll");
+		close(lfd);
+		return 1;
+	}
+
+	struct epoll_event ev = {0};
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; // the listening socket
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	while (1) {
+		int n = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+
+		for (int i = 0; i < n; i++) {
+			connection_t *conn = events[i].data.ptr;
+
+			// ------------------ New clients ------------------
+			if (!conn) {
+				int fd;
+				while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+					conn = calloc(1, sizeof(*conn));
+					if (conn)
+						conn->session = session_open();
+					if (!conn || !conn->session || set_nonblocking(fd) < 0) {
+						if (conn && conn->session)
+							session_close(conn->session);
+						free(conn);
+						close(fd);
+						continue;
+					}
+					conn->fd = fd;
+
+					struct epoll_event cev = {0};
+					cev.events = EPOLLIN;
+					cev.data.ptr = conn;
+					epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &cev);
+				}
+				continue;
+			}
+
+			// ------------------ Commands and responses ------------------
+			int ret = 0;
+			if (events[i].events & EPOLLOUT)
+				ret = flush_output(epfd, conn);
+
+			// a paused client continues once its output was sent
+			if (ret > 0 || (ret == 0 && !conn->paused &&
+							(events[i].events & (EPOLLIN | EPOLLHUP))))
+				ret = handle_input(epfd, conn);
+			if (ret < 0 || (events[i].events & EPOLLERR) ||
+				(conn->paused && (events[i].events & EPOLLHUP)))
+				close_connection(epfd, conn);
+		}
+	}
+
+	close(epfd);
+	close(lfd);
+	return 1;
+}
+
+// send all the bytes to a blocking socket
+static int send_all(int fd, const uint8_t *bytes, size_t size)
+{
+	while (size) {
+		ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (n < 0)
+			return 0;
+		bytes += n;
+		size -= n;
+	}
+	return 1;
+}
+
+// send a binary trace from the input to a server and print the output
+// of its commands
+int client(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = open_socket(path, &addr);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+
+	// the whole trace is sent before the responses are read; every record
+	// is forwarded as soon as it is complete, so the input can be a pipe
+	// (read() is not available here, it is a command of the allocator)
+	uint8_t buffer[SERVER_READ_SIZE];
+	uint8_t header[4];
+	while (fread(header, 1, 4, stdin) == 4) {
+		size_t rest = header[0] | header[1] << 8 | header[2] << 16 |
+					  (size_t)header[3] << 24;
+		int ok = send_all(fd, header, 4);
+		while (ok && rest) {
+			size_t n = rest < sizeof(buffer) ? rest : sizeof(buffer);
+			n = fread(buffer, 1, n, stdin);
+			if (!n)
+				break;
+			ok = send_all(fd, buffer, n);
+			rest -= n;
+		}
+		if (!ok) {
+			perror("send");
+			close(fd);
+			return 1;
+		}
+	}
+	shutdown(fd, SHUT_WR);
+
+	// every response is a u32 length followed by the output of a command
+	uint8_t *in = NULL;
+	size_t len = 0;
+	ssize_t ret;
+	while ((ret = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+		uint8_t *bytes = realloc(in, len + ret);
+		if (!bytes)
+			break;
+		in = bytes;
+		memcpy(in + len, buffer, ret);
+		len += ret;
+
+		size_t used = 0;
+		while (len - used >= 4) {
+			size_t size = in[used] | in[used + 1] << 8 |
+						  in[used + 2] << 16 | (size_t)in[used + 3] << 24;
+			if (len - used - 4 < size)
+				break;
+			fwrite(in + used + 4, 1, size, stdout);
+			used += 4 + size;
+		}
+		memmove(in, in + used, len - used);
+		len -= used;
+	}
+
+	free(in);
+	close(fd);
+	return 0;
+}
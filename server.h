@@ -0,0 +1,32 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// the clients of the server send records of the binary protocol and
+// receive, for every command, a u32 length followed by its output
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_SIZE 65536
+
+// a client that does not read its responses stops being served once this
+// many bytes of output wait to be sent
+#define SERVER_MAX_OUTPUT (4 * 1024 * 1024)
+
+// a client is disconnected when a record bigger than this is still not
+// complete, so the input kept for it stays bounded as well
+#define SERVER_MAX_INPUT (16 * 1024 * 1024)
+
+// the state kept for a client: its arena or the named arena it uses
+typedef struct session_t session_t;
+
+session_t *session_open(void);
+
+long session_feed(session_t *session, const uint8_t *bytes, size_t size,
+				  uint8_t **out, size_t *out_len, size_t max_len);
+
+void session_close(session_t *session);
+
+int serve(const char *path);
+
+int client(const char *path);
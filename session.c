@@ -0,0 +1,177 @@
+// COPYRIGHT: Larisa Florea
+
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include "server.h"
+
+// an arena shared by name between the clients of the server
+typedef struct named_arena_t {
+	char *name;
+	arena_t *arena;
+	unsigned int refs;
+	struct named_arena_t *next;
+} named_arena_t;
+
+struct session_t {
+	arena_t *arena; // the arena of the client
+	named_arena_t *named; // the named arena used instead, if any
+};
+
+static named_arena_t *named_arenas;
+
+static named_arena_t *find_named(const char *name)
+{
+	named_arena_t *named = named_arenas;
+	while (named && strcmp(named->name, name))
+		named = named->next;
+	return named;
+}
+
+// the arena shared under a name, for the commands that use other arenas
+static arena_t *find_arena(const char *name, int *found)
+{
+	named_arena_t *named = find_named(name);
+	*found = named != NULL;
+	return named ? named->arena : NULL;
+}
+
+session_t *session_open(void)
+{
+	command_named_arena = find_arena;
+
+	session_t *session = malloc(sizeof(*session));
+	if (!session) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return NULL;
+	}
+
+	session->arena = NULL;
+	session->named = NULL;
+	return session;
+}
+
+// stop using a named arena; the last client deallocates it
+static void detach(session_t *session)
+{
+	named_arena_t *named = session->named;
+	session->named = NULL;
+	if (!named || --named->refs)
+		return;
+
+	named_arena_t **curr = &named_arenas;
+	while (*curr != named)
+		curr = &(*curr)->next;
+	*curr = named->next;
+
+	if (named->arena) {
+		dealloc_arena(named->arena);
+		free(named->arena);
+	}
+	free(named->name);
+	free(named);
+}
+
+// use the arena with the given name (the own arena for an empty name)
+static void attach(session_t *session, const char *name)
+{
+	detach(session);
+	if (!name[0])
+		return;
+
+	named_arena_t *named = find_named(name);
+	if (!named) {
+		named = malloc(sizeof(*named));
+		if (!named) {
+			fprintf(stderr, "This zone could not be allocated\n");
+			return;
+		}
+		named->name = malloc(strlen(name) + 1);
+		if (!named->name) {
+			fprintf(stderr, "This zone could not be allocated\n");
+			free(named);
+			return;
+		}
+		strcpy(named->name, name);
+		named->arena = NULL;
+		named->refs = 0;
+		named->next = named_arenas;
+		named_arenas = named;
+	}
+
+	named->refs++;
+	session->named = named;
+}
+
+// append the output of a command to the responses
+static int append_response(uint8_t **out, size_t *out_len, const char *text,
+						   size_t len)
+{
+	uint8_t *bytes = realloc(*out, *out_len + 4 + len);
+	if (!bytes)
+		return 0;
+
+	for (int i = 0; i < 4; i++)
+		bytes[*out_len + i] = (uint8_t)(len >> (8 * i));
+	memcpy(bytes + *out_len + 4, text, len);
+	*out = bytes;
+	*out_len += 4 + len;
+	return 1;
+}
+
+// execute the complete records from bytes, until the responses reach
+// max_len bytes; return the number of bytes used or -1 if a record is
+// corrupted
+long session_feed(session_t *session, const uint8_t *bytes, size_t size,
+				  uint8_t **out, size_t *out_len, size_t max_len)
+{
+	long used = 0;
+	command_t cmd;
+	uint64_t time;
+
+	while (*out_len < max_len) {
+		long ret = trace_decode(bytes + used, size - used, &cmd, &time);
+		if (ret <= 0)
+			return ret < 0 ? -1 : used;
+		used += ret;
+
+		// the output of the command is captured instead of printed
+		char *text = NULL;
+		size_t len = 0;
+		FILE *console = stdout;
+		stdout = open_memstream(&text, &len);
+		if (!stdout) {
+			stdout = console;
+			free_command(&cmd);
+			return -1;
+		}
+
+		if (cmd.type == 18) { // ATTACH
+			attach(session, cmd.data ? (char *)cmd.data : "");
+		} else {
+			arena_t **arena = &session->arena;
+			if (session->named)
+				arena = &session->named->arena;
+			execute_command(arena, &cmd);
+		}
+		free_command(&cmd);
+
+		fclose(stdout);
+		stdout = console;
+		int ok = append_response(out, out_len, text, len);
+		free(text);
+		if (!ok)
+			return -1;
+	}
+
+	return used;
+}
+
+void session_close(session_t *session)
+{
+	detach(session);
+	if (session->arena) {
+		dealloc_arena(session->arena);
+		free(session->arena);
+	}
+	free(session);
+}
@@ -0,0 +1,201 @@
+// COPYRIGHT: Larisa Florea
+
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "trace.h"
+
+static void put_number(uint8_t *bytes, uint64_t x, int n)
+{
+	for (int i = 0; i < n; i++)
+		bytes[i] = (uint8_t)(x >> (8 * i));
+}
+
+static uint64_t get_number(const uint8_t *bytes, int n)
+{
+	uint64_t x = 0;
+	for (int i = 0; i < n; i++)
+		x |= (uint64_t)bytes[i] << (8 * i);
+	return x;
+}
+
+// return the time in nanoseconds from a fixed point in the past
+uint64_t trace_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// build the record of a command
+uint8_t *trace_encode(const command_t *cmd, int timestamp, uint64_t time,
+					  size_t *size)
+{
+	if (cmd->argc > TRACE_MAX_ARGUMENTS) {
+		fprintf(stderr, "The command has too many arguments for a trace\n");
+		return NULL;
+	}
+
+	uint64_t len = cmd->data ? cmd->len : 0;
+	*size = TRACE_HEADER + 8 * cmd->argc + len;
+	if (timestamp)
+		*size += 8;
+
+	uint8_t *bytes = malloc(*size);
+	if (!bytes) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return NULL;
+	}
+
+	put_number(bytes, *size - 4, 4);
+	bytes[4] = (uint8_t)cmd->type;
+	bytes[5] = timestamp ? TRACE_TIMESTAMP : 0;
+	put_number(bytes + 6, cmd->argc, 2);
+
+	uint8_t *curr = bytes + TRACE_HEADER;
+	if (timestamp) {
+		put_number(curr, time, 8);
+		curr += 8;
+	}
+	for (long i = 0; i < cmd->argc; i++) {
+		put_number(curr, cmd->argv[i], 8);
+		curr += 8;
+	}
+	if (len)
+		memcpy(curr, cmd->data, len);
+
+	return bytes;
+}
+
+// read a command from a buffer; return the number of bytes used, 0 if the
+// record is not complete yet and -1 if it is corrupted
+long trace_decode(const uint8_t *bytes, size_t size, command_t *cmd,
+				  uint64_t *time)
+{
+	memset(cmd, 0, sizeof(*cmd));
+	if (size < TRACE_HEADER)
+		return 0;
+
+	uint64_t length = get_number(bytes, 4) + 4;
+	if (length < TRACE_HEADER || length > TRACE_MAX_RECORD)
+		return -1;
+	if (size < length)
+		return 0;
+
+	// every unknown code is an invalid command, not only the one of -1
+	cmd->type = bytes[4];
+	if (cmd->type < 1 || cmd->type > COMMAND_LAST)
+		cmd->type = -1;
+	int flags = bytes[5];
+	long argc = (long)get_number(bytes + 6, 2);
+
+	const uint8_t *curr = bytes + TRACE_HEADER;
+	uint64_t fixed = TRACE_HEADER + 8 * argc;
+	if (flags & TRACE_TIMESTAMP)
+		fixed += 8;
+	if (fixed > length)
+		return -1;
+
+	*time = 0;
+	if (flags & TRACE_TIMESTAMP) {
+		*time = get_number(curr, 8);
+		curr += 8;
+	}
+
+	cmd->argv = malloc((argc + 1) * sizeof(uint64_t));
+	cmd->len = length - fixed;
+	cmd->data = malloc(cmd->len + 1);
+	if (!cmd->argv || !cmd->data) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		free_command(cmd);
+		return -1;
+	}
+
+	for (cmd->argc = 0; cmd->argc < argc; cmd->argc++) {
+		cmd->argv[cmd->argc] = get_number(curr, 8);
+		curr += 8;
+	}
+	memcpy(cmd->data, curr, cmd->len);
+	cmd->data[cmd->len] = '\0';
+
+	return (long)length;
+}
+
+// append the record of a command to a trace
+int trace_write(FILE *file, const command_t *cmd, int timestamp,
+				uint64_t time)
+{
+	size_t size;
+	uint8_t *bytes = trace_encode(cmd, timestamp, time, &size);
+	if (!bytes)
+		return 0;
+
+	int ret = fwrite(bytes, 1, size, file) == size;
+	free(bytes);
+	return ret;
+}
+
+// read the next record of a trace; return 0 at its end
+int trace_read(FILE *file, command_t *cmd, uint64_t *time)
+{
+	uint8_t header[4];
+	memset(cmd, 0, sizeof(*cmd));
+	if (fread(header, 1, 4, file) != 4)
+		return 0;
+
+	uint64_t length = get_number(header, 4) + 4;
+	if (length < TRACE_HEADER || length > TRACE_MAX_RECORD)
+		return 0;
+
+	uint8_t *bytes = malloc(length);
+	if (!bytes) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return 0;
+	}
+
+	memcpy(bytes, header, 4);
+	int ret = 0;
+	if (fread(bytes + 4, 1, length - 4, file) == length - 4)
+		ret = trace_decode(bytes, length, cmd, time) > 0;
+	free(bytes);
+
+	return ret;
+}
+
+// execute the commands of a binary trace, as fast as possible or
+// keeping the time between them
+int replay_trace(FILE *file, int timed)
+{
+	arena_t *arena = NULL;
+	command_t cmd;
+	uint64_t time, first = 0, start = trace_clock();
+	int exit = 1, records = 0;
+
+	while (exit && trace_read(file, &cmd, &time)) {
+		if (timed) {
+			if (!records)
+				first = time;
+
+			// wait until the moment of the command from the trace
+			uint64_t now = trace_clock() - start;
+			if (time > first && time - first > now) {
+				uint64_t wait = time - first - now;
+				struct timespec ts;
+				ts.tv_sec = wait / 1000000000ULL;
+				ts.tv_nsec = wait % 1000000000ULL;
+				fflush(stdout);
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		exit = execute_command(&arena, &cmd);
+		free_command(&cmd);
+		records++;
+	}
+
+	if (arena) {
+		dealloc_arena(arena);
+		free(arena);
+	}
+
+	return 0;
+}
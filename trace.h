@@ -0,0 +1,36 @@
+// COPYRIGHT: Larisa Florea
+
+#pragma once
+#include "command.h"
+
+// A command of the binary protocol is a record with little-endian fields:
+//   u32  length of the rest of the record
+//   u8   code of the command (the value returned by convert())
+//   u8   flags
+//   u16  number of arguments
+//   u64  timestamp in nanoseconds, only if TRACE_TIMESTAMP is set
+//   u64  arguments
+//   the data of the command (written text, permissions or options)
+#define TRACE_HEADER 8
+#define TRACE_TIMESTAMP 1
+
+// the number of arguments must fit its u16 field
+#define TRACE_MAX_ARGUMENTS 0xFFFF
+
+// records bigger than this are considered corrupted
+#define TRACE_MAX_RECORD (1ULL << 31)
+
+uint64_t trace_clock(void);
+
+uint8_t *trace_encode(const command_t *cmd, int timestamp, uint64_t time,
+					  size_t *size);
+
+long trace_decode(const uint8_t *bytes, size_t size, command_t *cmd,
+				  uint64_t *time);
+
+int trace_write(FILE *file, const command_t *cmd, int timestamp,
+				uint64_t time);
+
+int trace_read(FILE *file, command_t *cmd, uint64_t *time);
+
+int replay_trace(FILE *file, int timed);
@@ -9,7 +9,34 @@ arena_t *alloc_arena(const uint64_t size)
 	if (!arena)
 		fprintf(stderr, "This zone could not be allocated\n");
 	arena->arena_size = size;
-	arena->alloc_list = NULL;
+	arena->head = NULL;
+	arena->count = 0;
+	arena->mb_count = 0;
+	arena->alloc_size = 0;
+	buffer_cache_init(&arena->cache);
+	arena->gap_root = NULL;
+	pool_init(&arena->gap_pool, sizeof(gap_node_t));
+	arena->gap_seed = 2463534242u;
+	arena->largest_gap = 0;
+	arena->gap_count = 0;
+	memset(arena->gap_hist, 0, sizeof(arena->gap_hist));
+	memset(arena->block_hist, 0, sizeof(arena->block_hist));
+	gap_add(arena, size);
+	arena->compacting = 0;
+	arena->compact_threshold = 0;
+	arena->compact_block = NULL;
+	arena->compact_mb = NULL;
+#if VMA_HEATMAP
+	arena->heat_accesses = 0;
+	arena->heat_epoch = 0;
+#endif
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	arena->cursor = NULL;
+#endif
+#if VMA_META == VMA_META_POOL
+	pool_init(&arena->block_pool, sizeof(block_t));
+	pool_init(&arena->miniblock_pool, sizeof(miniblock_t));
+#endif
 
 	return arena;
 }
@@ -17,193 +44,424 @@ arena_t *alloc_arena(const uint64_t size)
 // deallocate an arena
 void dealloc_arena(arena_t *arena)
 {
-	if (!arena->alloc_list)
-		return;
-
-	node *curr1, *curr2;
-	node *prev1, *prev2;
-	curr1 = arena->alloc_list->head;
+	block_t *curr1 = arena->head, *prev1;
+	miniblock_t *curr2, *prev2;
+	reclaim_batch_t batch = {NULL, NULL, 0, 0};
 
+	// the zones are only unlinked here, the reclamation workers (if any)
+	// release them in batches
 	while (curr1) {
-		list_t *l = (list_t *)curr1->data_b->miniblock_list;
-		curr2 = l->head;
+		curr2 = curr1->head;
 		while (curr2) {
 			prev2 = curr2;
 			curr2 = curr2->next;
-			int8_t *buffer = (int8_t *)prev2->data_mb->rw_buffer;
-			free(buffer);
-			free(prev2->data_mb);
-			free(prev2);
+			if (miniblock_shared(prev2)) {
+				buffer_unshare(NULL, prev2->ext->shared);
+				prev2->ext->shared = NULL;
+			} else {
+				reclaim_add(&batch, prev2->rw_buffer, prev2->size);
+			}
+			heat_reset_pages(prev2);
+			trim_ext(prev2);
+#if VMA_META == VMA_META_POOL
+			meta_free(arena, miniblock_pool, prev2);
+#else
+			reclaim_add(&batch, prev2, 0);
+#endif
 		}
 		prev1 = curr1;
 		curr1 = curr1->next;
-		free(l);
-		free(prev1->data_b);
-		free(prev1);
+#if VMA_META == VMA_META_POOL
+		meta_free(arena, block_pool, prev1);
+#else
+		reclaim_add(&batch, prev1, 0);
+#endif
 	}
-	free(arena->alloc_list);
+	reclaim_flush(&batch);
+	arena->head = NULL;
+	arena->count = 0;
+	arena->mb_count = 0;
+	arena->compacting = 0;
+	arena->compact_block = NULL;
+	arena->compact_mb = NULL;
+	arena->alloc_size = 0;
+	arena->gap_root = NULL;
+	pool_destroy(&arena->gap_pool);
+	arena->largest_gap = 0;
+	arena->gap_count = 0;
+	memset(arena->gap_hist, 0, sizeof(arena->gap_hist));
+	memset(arena->block_hist, 0, sizeof(arena->block_hist));
+	buffer_cache_destroy(&arena->cache);
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	arena->cursor = NULL;
+#endif
+#if VMA_META == VMA_META_POOL
+	pool_destroy(&arena->block_pool);
+	pool_destroy(&arena->miniblock_pool);
+#endif
 }
 
-// allocate a new list
-list_t *create_list(void)
+// allocate a new miniblock, with a clean buffer
+miniblock_t *new_miniblock(arena_t *arena, uint64_t address, uint64_t size)
 {
-	list_t *list = malloc(sizeof(*list));
-	if (!list)
+	miniblock_t *mb = meta_alloc(arena, miniblock_pool, sizeof(*mb));
+	if (!mb) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return NULL;
+	}
+
+	mb->start_address = address;
+	mb->size = size;
+	mb->perm = 6;
+	mb->next = NULL;
+	mb->prev = NULL;
+	mb->rw_buffer = buffer_get(&arena->cache, size);
+	mb->dirty = 0;
+	mb->ext = NULL;
+#if VMA_HEATMAP
+	mb->heat_read = 0;
+	mb->heat_write = 0;
+	mb->heat_epoch = arena->heat_epoch;
+#endif
+	if (!mb->rw_buffer)
 		fprintf(stderr, "This zone could not be allocated\n");
-	list->head = NULL;
-	list->size = 0;
-	list->list_size = 0;
 
-	return list;
+	return mb;
 }
 
-// return the n-th node from a list
-node *get_nth_node(list_t *list, long n)
+// return the optional fields of a miniblock, allocating them if needed
+miniblock_ext_t *miniblock_ext(miniblock_t *mb)
 {
-	if (!list->head)
-		return NULL;
+	if (!mb->ext) {
+		mb->ext = calloc(1, sizeof(miniblock_ext_t));
+		if (!mb->ext)
+			fprintf(stderr, "This zone could not be allocated\n");
+	}
+	return mb->ext;
+}
 
-	node *curr = list->head;
+// release the optional fields of a miniblock once none of them is set
+void trim_ext(miniblock_t *mb)
+{
+	if (!mb->ext || mb->ext->shared)
+		return;
+#if VMA_HEATMAP
+	if (mb->ext->page_heat)
+		return;
+#endif
+	free(mb->ext);
+	mb->ext = NULL;
+}
 
-	while (n > 0) {
-		curr = curr->next;
-		n--;
+// return the number of bytes of the buffer that could have been written
+uint64_t dirty_size(const miniblock_t *mb)
+{
+	return mb->dirty == DIRTY_MAX ? mb->size : mb->dirty;
+}
+
+// change the mark of the written bytes, saturating at DIRTY_MAX
+void set_dirty(miniblock_t *mb, uint64_t dirty)
+{
+	mb->dirty = dirty < DIRTY_MAX ? dirty : DIRTY_MAX;
+}
+
+// add a miniblock to a block, after prev (at the beginning if prev is NULL)
+void insert_miniblock(arena_t *arena, block_t *block, miniblock_t *prev,
+					  miniblock_t *mb)
+{
+	mb->prev = prev;
+	if (prev) {
+		mb->next = prev->next;
+		prev->next = mb;
+	} else {
+		mb->next = block->head;
+		block->head = mb;
 	}
 
-	return curr;
+	if (mb->next)
+		mb->next->prev = mb;
+	else
+		block->tail = mb;
+
+	block->count++;
+	frag_block(arena, block->count - 1, block->count);
+	block->size += mb->size;
+	arena->mb_count++;
+	arena->alloc_size += mb->size;
+	gap_fill(arena, block, mb->start_address, mb->size);
+	check_compact(arena, block);
 }
 
-// add a new node to the n-th position in a list
-node *add_nth_node(list_t *list, long n)
+// add a new block after prev (at the beginning if prev is NULL)
+block_t *add_new_block(arena_t *arena, uint64_t address, uint64_t size,
+					   block_t *prev)
 {
-	node *curr = get_nth_node(list, n - 1);
-	node *new_node = malloc(sizeof(*new_node));
-	if (!new_node)
+	block_t *block = meta_alloc(arena, block_pool, sizeof(*block));
+	if (!block) {
 		fprintf(stderr, "This zone could not be allocated\n");
+		return NULL;
+	}
 
-	if (list->size == 0) {
-		list->head = new_node;
-		new_node->next = NULL;
-		new_node->prev = NULL;
+	block->start_address = address;
+	block->size = 0;
+	block->count = 0;
+	block->head = NULL;
+	block->tail = NULL;
 
+	block->prev = prev;
+	if (prev) {
+		block->next = prev->next;
+		prev->next = block;
 	} else {
-		if ((long)list->size == n) {
-			curr->next = new_node;
-			new_node->prev = curr;
-			new_node->next = NULL;
-		} else {
-			if (n == 0) {
-				new_node->next = curr;
-				list->head = new_node;
-				new_node->prev = NULL;
-				curr->prev = list->head;
-			} else {
-				new_node->prev = curr;
-				new_node->next = curr->next;
+		block->next = arena->head;
+		arena->head = block;
+	}
+	if (block->next)
+		block->next->prev = block;
+	arena->count++;
 
-				curr->next->prev = new_node;
-				curr->next = new_node;
-			}
+	// add the new miniblock that is generated by the new block
+	insert_miniblock(arena, block, NULL, new_miniblock(arena, address, size));
+
+	return block;
+}
+
+// chain a block with the one that follows it
+void chain_block(arena_t *arena, block_t *block)
+{
+	block_t *next = block->next;
+
+	// the miniblocks of the second block are added after the last
+	// miniblock of the first block
+	block->tail->next = next->head;
+	next->head->prev = block->tail;
+	block->tail = next->tail;
+	block->size += next->size;
+	frag_block(arena, block->count, block->count + next->count);
+	frag_block(arena, next->count, 0);
+	block->count += next->count;
+
+	block->next = next->next;
+	if (next->next)
+		next->next->prev = block;
+
+	// deallocate the resources of the second block
+	if (arena->compact_block == next)
+		arena->compact_block = block;
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	if (arena->cursor == next)
+		arena->cursor = block;
+#endif
+	meta_free(arena, block_pool, next);
+	arena->count--;
+	check_compact(arena, block);
+}
+
+// return the bucket of the histograms for a size or a count
+int frag_bucket(uint64_t x)
+{
+	int bucket = 0;
+	while (x >>= 1)
+		bucket++;
+	return bucket;
+}
+
+gap_node_t *gap_rotate_left(gap_node_t *node)
+{
+	gap_node_t *right = node->right;
+	node->right = right->left;
+	right->left = node;
+	return right;
+}
+
+gap_node_t *gap_rotate_right(gap_node_t *node)
+{
+	gap_node_t *left = node->left;
+	node->left = left->right;
+	left->right = node;
+	return left;
+}
+
+// count one more free zone of this size in the treap of a subtree;
+// return the new root of the subtree
+gap_node_t *gap_insert(arena_t *arena, gap_node_t *node, uint64_t size)
+{
+	if (!node) {
+		node = pool_alloc(&arena->gap_pool);
+		if (!node) {
+			fprintf(stderr, "This zone could not be allocated\n");
+			return NULL;
 		}
+
+		// xorshift, the shape of the treap does not depend on the sizes
+		arena->gap_seed ^= arena->gap_seed << 13;
+		arena->gap_seed ^= arena->gap_seed >> 17;
+		arena->gap_seed ^= arena->gap_seed << 5;
+		node->size = size;
+		node->count = 1;
+		node->priority = arena->gap_seed;
+		node->left = NULL;
+		node->right = NULL;
+		return node;
+	}
+
+	if (size < node->size) {
+		node->left = gap_insert(arena, node->left, size);
+		if (node->left && node->left->priority > node->priority)
+			node = gap_rotate_right(node);
+	} else if (size > node->size) {
+		node->right = gap_insert(arena, node->right, size);
+		if (node->right && node->right->priority > node->priority)
+			node = gap_rotate_left(node);
+	} else {
+		node->count++;
 	}
 
-	list->size++;
-	return new_node;
+	return node;
 }
 
-// add a new miniblock
-void add_new_miniblock(node *node, uint64_t address, uint64_t size, long n)
+// remove a node from the treap, rotating it down until it has a single
+// child; return the new root of the subtree
+gap_node_t *gap_unlink(arena_t *arena, gap_node_t *node)
 {
-	list_t *l = (list_t *)(node->data_b->miniblock_list);
+	if (!node->left || !node->right) {
+		gap_node_t *child = node->left ? node->left : node->right;
+		pool_free(&arena->gap_pool, node);
+		return child;
+	}
 
-	// add the new node to the n-th position in the list
-	struct node *new_node = add_nth_node(l, n);
+	if (node->left->priority > node->right->priority) {
+		node = gap_rotate_right(node);
+		node->right = gap_unlink(arena, node->right);
+	} else {
+		node = gap_rotate_left(node);
+		node->left = gap_unlink(arena, node->left);
+	}
+	return node;
+}
 
-	// allocate the new miniblock
-	new_node->data_mb = malloc(sizeof(miniblock_t));
-	if (!new_node->data_mb)
-		fprintf(stderr, "This zone could not be allocated\n");
+// count one less free zone of this size; return the new root
+gap_node_t *gap_erase(arena_t *arena, gap_node_t *node, uint64_t size)
+{
+	if (!node)
+		return NULL;
 
-	// initialize the new miniblock
-	new_node->data_mb->start_address = address;
-	new_node->data_mb->size = size;
-	new_node->data_mb->perm = 6;
-	new_node->data_mb->rw_buffer = calloc(size, sizeof(int8_t));
-	if (!new_node->data_mb->rw_buffer)
-		fprintf(stderr, "This zone could not be allocated\n");
+	if (size < node->size)
+		node->left = gap_erase(arena, node->left, size);
+	else if (size > node->size)
+		node->right = gap_erase(arena, node->right, size);
+	else if (!--node->count)
+		node = gap_unlink(arena, node);
+	return node;
+}
 
-	l->list_size += size;
-	node->data_b->size += size;
+// the largest size of a treap (0 if it is empty)
+uint64_t gap_max(const gap_node_t *node)
+{
+	if (!node)
+		return 0;
+	while (node->right)
+		node = node->right;
+	return node->size;
 }
 
-// add a new block
-void add_new_block(arena_t *arena, uint64_t address, uint64_t size, long n)
+// a free zone of the arena appeared
+void gap_add(arena_t *arena, uint64_t size)
 {
-	// add the new node to the n-th position in the list
-	node *new_node = add_nth_node(arena->alloc_list, n);
-	if (!new_node)
-		fprintf(stderr, "This zone could not be allocated\n");
+	if (!size)
+		return;
 
-	// allocate the new block
-	new_node->data_b = malloc(sizeof(block_t));
-	if (!new_node->data_b)
-		fprintf(stderr, "This zone could not be allocated\n");
-	new_node->data_b->start_address = address;
-	new_node->data_b->size = 0;
+	arena->gap_count++;
+	arena->gap_hist[frag_bucket(size)]++;
+	arena->gap_root = gap_insert(arena, arena->gap_root, size);
+	if (size > arena->largest_gap)
+		arena->largest_gap = size;
+}
 
-	// add the new miniblock that is generated by the new block
-	new_node->data_b->miniblock_list = create_list();
-	add_new_miniblock(new_node, address, size, 0);
+// a free zone of the arena disappeared
+void gap_remove(arena_t *arena, uint64_t size)
+{
+	if (!size)
+		return;
 
-	arena->alloc_list->list_size += size;
+	arena->gap_count--;
+	arena->gap_hist[frag_bucket(size)]--;
+	arena->gap_root = gap_erase(arena, arena->gap_root, size);
+
+	// the next largest zone is the rightmost size of the treap
+	if (size == arena->largest_gap)
+		arena->largest_gap = gap_max(arena->gap_root);
 }
 
-// chain two blocks
-void chain_block(node *node)
+// the number of miniblocks of a block changed (0 for a block that
+// appears or disappears)
+void frag_block(arena_t *arena, uint64_t count, uint64_t new_count)
 {
-	struct node *next = node->next;
-	list_t *l1, *l2;
+	if (count)
+		arena->block_hist[frag_bucket(count)]--;
+	if (new_count)
+		arena->block_hist[frag_bucket(new_count)]++;
+}
 
-	l1 = (list_t *)node->data_b->miniblock_list;
-	l2 = (list_t *)next->data_b->miniblock_list;
+// return the free zones around a range of a block: the range can only
+// touch free memory at the margins of the block
+void gap_margins(arena_t *arena, block_t *block, uint64_t address,
+				 uint64_t size, uint64_t *before, uint64_t *after)
+{
+	uint64_t end = block->start_address + block->size;
+	*before = 0;
+	*after = 0;
+
+	if (address == block->start_address) {
+		uint64_t prev_end = 0;
+		if (block->prev)
+			prev_end = block->prev->start_address + block->prev->size;
+		*before = address - prev_end;
+	}
 
-	// the second block is added to the first block
-	// the size of the lists is updated
-	l1->list_size += l2->list_size;
-	l1->size += l2->size;
-	node->data_b->size = l1->list_size;
+	if (address + size == end) {
+		uint64_t next_start = arena->arena_size;
+		if (block->next)
+			next_start = block->next->start_address;
+		*after = next_start - end;
+	}
+}
 
-	// find the address last miniblock in the first block
-	struct node *curr = l1->head;
-	while (curr->next)
-		curr = curr->next;
+// a range that was free is now part of a block
+void gap_fill(arena_t *arena, block_t *block, uint64_t address,
+			  uint64_t size)
+{
+	uint64_t before, after;
+	gap_margins(arena, block, address, size, &before, &after);
 
-	// chain the last miniblock from the first block 
-	// to the first miniblock from the second block
-	curr->next = l2->head;
-	l2->head->prev = curr;
+	gap_remove(arena, before + size + after);
+	gap_add(arena, before);
+	gap_add(arena, after);
+}
 
-	node->next = next->next;
-	next->prev = node;
+// a range of a block is about to become free
+void gap_release(arena_t *arena, block_t *block, uint64_t address,
+				 uint64_t size)
+{
+	uint64_t before, after;
+	gap_margins(arena, block, address, size, &before, &after);
 
-	// deallocate the resources of the second block
-	free(l2);
-	free(next->data_b);
-	free(next);
+	gap_remove(arena, before);
+	gap_remove(arena, after);
+	gap_add(arena, before + size + after);
 }
 
-// return the size of a list
-size_t list_size(list_t *list)
+// return the largest free zone, kept up to date by gap_add and gap_remove
+uint64_t largest_gap(arena_t *arena)
 {
-	return list->size;
+	return arena->largest_gap;
 }
 
-int cases(node *node, const uint64_t address, const uint64_t size)
+int cases(block_t *block, const uint64_t address, const uint64_t size)
 {
 	uint64_t dim_node = address + size;
-	uint64_t start_address = node->data_b->start_address;
-	size_t size_bl = node->data_b->size;
-	uint64_t dim_bl = start_address + size_bl;
+	uint64_t start_address = block->start_address;
+	uint64_t dim_bl = start_address + block->size;
 
 	// ---------- Cases in which we cannot allocate -------------
 
@@ -213,25 +471,25 @@ int cases(node *node, const uint64_t address, const uint64_t size)
 	if (address <= start_address && dim_node > start_address)
 		return 0;
 
-	if (node->next)
-		if (dim_bl <= address && dim_node > node->next->data_b->start_address)
+	if (block->next)
+		if (dim_bl <= address && dim_node > block->next->start_address)
 			return 0;
 
 	// ---------------Cases in which we can allocate ----------------
 	if (dim_node == start_address)
 		return 4;
 
-	if (!node->next) {
+	if (!block->next) {
 		if (address > dim_bl)
 			return 1;
 
 		if (dim_bl == address)
 			return 3;
 	} else {
-		if (address > dim_bl && dim_node < node->next->data_b->start_address)
+		if (address > dim_bl && dim_node < block->next->start_address)
 			return 1;
 
-		if (dim_bl == address && dim_node == node->next->data_b->start_address)
+		if (dim_bl == address && dim_node == block->next->start_address)
 			return 2;
 	}
 
@@ -246,23 +504,20 @@ int cases(node *node, const uint64_t address, const uint64_t size)
 
 void find_block(arena_t *arena, const uint64_t address, const uint64_t size)
 {
-	node *curr = arena->alloc_list->head;
-	node *prev = curr;
+	block_t *curr = arena->head;
+	block_t *prev = curr;
 
 	int ok = 0;
-	long pos = 0;
 
-	// finding the position of the block in which the miniblock will be inserted
+	// finding the block in which the miniblock will be inserted
 	while (curr && ok == 0) {
 		ok = cases(curr, address, size);
 		prev = curr;
 		curr = curr->next;
-		pos++;
 
 		uint64_t dim_node = address + size;
-		uint64_t start_address = prev->data_b->start_address;
-		size_t size_bl = prev->data_b->size;
-		uint64_t dim_bl = start_address + size_bl;
+		uint64_t start_address = prev->start_address;
+		uint64_t dim_bl = start_address + prev->size;
 
 		// cases in which we cannot allocate
 		if (address >= arena->arena_size) {
@@ -284,27 +539,24 @@ void find_block(arena_t *arena, const uint64_t address, const uint64_t size)
 
 	switch (ok) {
 	case 1: // allocate a new block after the current block
-		add_new_block(arena, address, size, pos);
+		add_new_block(arena, address, size, prev);
 		break;
 	case 2: // chain two blocks
-		pos = list_size((list_t *)prev->data_b->miniblock_list);
-		add_new_miniblock(prev, address, size, pos);
-		chain_block(prev);
-		arena->alloc_list->size--;
-		arena->alloc_list->list_size += size;
+		insert_miniblock(arena, prev, prev->tail,
+						 new_miniblock(arena, address, size));
+		chain_block(arena, prev);
 		break;
 	case 3: // add a new miniblock at the end of the current block
-		pos = list_size((list_t *)prev->data_b->miniblock_list);
-		add_new_miniblock(prev, address, size, pos);
-		arena->alloc_list->list_size += size;
+		insert_miniblock(arena, prev, prev->tail,
+						 new_miniblock(arena, address, size));
 		break;
 	case 4: // add a new miniblock at the beginning of the current block
-		add_new_miniblock(prev, address, size, 0);
-		prev->data_b->start_address = address;
-		arena->alloc_list->list_size += size;
+		prev->start_address = address;
+		insert_miniblock(arena, prev, NULL,
+						 new_miniblock(arena, address, size));
 		break;
 	case 5: // add a new block before the current block
-		add_new_block(arena, address, size, pos - 1);
+		add_new_block(arena, address, size, prev->prev);
 		break;
 	default: // the zone was already allocated
 		printf("This zone was already allocated.\n");
@@ -312,334 +564,321 @@ void find_block(arena_t *arena, const uint64_t address, const uint64_t size)
 	}
 }
 
-
 void alloc_block(arena_t *arena, const uint64_t address, const uint64_t size)
 {
-	if (!arena->alloc_list) {
-		arena->alloc_list = create_list();
-		add_new_block(arena, address, size, 0);
+	if (!arena->head) {
+		if (address >= arena->arena_size)
+			printf("The allocated address is outside the size of arena\n");
+		else if (address + size > arena->arena_size)
+			printf("The end address is past the size of the arena\n");
+		else
+			add_new_block(arena, address, size, NULL);
 		return;
 	}
 
-	if (arena->alloc_list->size == 0) {
-		add_new_block(arena, address, size, 0);
+	find_block(arena, address, size);
+}
+
+// give the buffer of a miniblock to the cache; a shared buffer is kept
+// until its last mapping goes away
+void put_buffer(arena_t *arena, miniblock_t *mb)
+{
+	if (miniblock_shared(mb)) {
+		buffer_unshare(&arena->cache, mb->ext->shared);
+		mb->ext->shared = NULL;
+		trim_ext(mb);
 		return;
 	}
 
-	find_block(arena, address, size);
+	buffer_put(&arena->cache, mb->rw_buffer, mb->size, dirty_size(mb));
 }
 
-// remove the n-th node from a list
-void remove_nth_node(list_t *list, node *node, long n, int type)
+// remove a miniblock from its block and give its buffer to the cache
+void remove_miniblock(arena_t *arena, block_t *block, miniblock_t *mb)
 {
-	if (list->size == 1) {
-		list->head = NULL;
-	} else {
-		if (n == 1) {
-			list->head = node->next;
-			node->next->prev = NULL;
-		} else {
-			if (n == (long)list->size) {
-				node->prev->next = NULL;
-			} else {
-				node->prev->next = node->next;
-				node->next->prev = node->prev;
-			}
-		}
+	gap_release(arena, block, mb->start_address, mb->size);
+
+	// the compaction continues from the miniblock (or block) before
+	if (arena->compact_mb == mb)
+		arena->compact_mb = mb->prev;
+	if (arena->compact_block == block && !mb->prev) {
+		arena->compact_block = block->prev;
+		arena->compact_mb = NULL;
 	}
 
-	list->size--;
+	if (mb->prev)
+		mb->prev->next = mb->next;
+	else
+		block->head = mb->next;
 
-	// deallocate the resources of the removed node
-	if (type == 1) {
-		list->list_size -= node->data_b->size;
-		free(node->data_b->miniblock_list);
-		free(node->data_b);
-	} else {
-		list->list_size -= node->data_mb->size;
-		free(node->data_mb->rw_buffer);
-		free(node->data_mb);
+	if (mb->next)
+		mb->next->prev = mb->prev;
+	else
+		block->tail = mb->prev;
+
+	block->count--;
+	frag_block(arena, block->count + 1, block->count);
+	block->size -= mb->size;
+	arena->mb_count--;
+	arena->alloc_size -= mb->size;
+
+	// deallocate the resources of the removed miniblock
+	put_buffer(arena, mb);
+	heat_reset_pages(mb);
+	meta_free(arena, miniblock_pool, mb);
+}
+
+// remove a block that has no more miniblocks
+void remove_block(arena_t *arena, block_t *block)
+{
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		arena->head = block->next;
+
+	if (block->next)
+		block->next->prev = block->prev;
+
+	arena->count--;
+	if (arena->compact_block == block) {
+		arena->compact_block = block->prev;
+		arena->compact_mb = NULL;
 	}
-	free(node);
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	if (arena->cursor == block)
+		arena->cursor = block->prev;
+#endif
+	meta_free(arena, block_pool, block);
 }
 
-// verify if an address is the start address of a block
-void search_block(list_t *list, uint64_t address, node **node_find, long *pos)
+// return the block that holds an address
+block_t *search_block(arena_t *arena, uint64_t address)
 {
-	node *curr = list->head;
-	*node_find = NULL;
-	*pos = 0;
-	while (curr) {
-		(*pos)++;
-		uint64_t start_address = curr->data_b->start_address;
-		uint64_t dim = start_address + curr->data_b->size;
-		if (address >= start_address && address < dim) {
-			*node_find = curr;
-			break;
+	block_t *curr = arena->head;
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	// the blocks are sorted, so the search can continue from the last
+	// block found if the address is not before it
+	if (arena->cursor && arena->cursor->start_address <= address)
+		curr = arena->cursor;
+#endif
+	while (curr && curr->start_address <= address) {
+		uint64_t start_address = curr->start_address;
+		uint64_t dim = start_address + curr->size;
+		if (address < dim) {
+#if VMA_INDEX == VMA_INDEX_CURSOR
+			arena->cursor = curr;
+#endif
+			return curr;
 		}
 		curr = curr->next;
 	}
+
+	return NULL;
 }
 
-// verify if an address is the start address of a miniblock
-void
-search_miniblock1(list_t *list, uint64_t address, node **node_find, long *pos)
+// return the miniblock that starts at an address
+miniblock_t *search_miniblock1(block_t *block, uint64_t address)
 {
-	node *curr = list->head;
-	*node_find = NULL;
-	*pos = 0;
+	miniblock_t *curr = block->head;
 	while (curr) {
-		(*pos)++;
-		if (address == curr->data_mb->start_address) {
-			*node_find = curr;
-			break;
-		}
+		if (address == curr->start_address)
+			return curr;
 		curr = curr->next;
 	}
+
+	return NULL;
 }
 
-// deallocate a block/miniblock
-void free_block(arena_t *arena, const uint64_t address)
+// split a block in two, the second one starting with the miniblock first
+void split_block(arena_t *arena, block_t *block, miniblock_t *first)
 {
-	if (!arena->alloc_list) {
-		printf("Invalid address for free.\n");
+	block_t *new_block = meta_alloc(arena, block_pool, sizeof(*new_block));
+	if (!new_block) {
+		fprintf(stderr, "This zone could not be allocated\n");
 		return;
 	}
 
-	node *node_find_b = NULL; long pos_b = 0; // position of the block
-	search_block(arena->alloc_list, address, &node_find_b, &pos_b);
+	new_block->start_address = first->start_address;
+	new_block->size = 0;
+	new_block->count = 0;
+	for (miniblock_t *curr = first; curr; curr = curr->next) {
+		new_block->size += curr->size;
+		new_block->count++;
+	}
+
+	new_block->head = first;
+	new_block->tail = block->tail;
+	block->tail = first->prev;
+	block->size -= new_block->size;
+	frag_block(arena, block->count, block->count - new_block->count);
+	frag_block(arena, 0, new_block->count);
+	block->count -= new_block->count;
+	first->prev->next = NULL; first->prev = NULL;
+
+	new_block->prev = block;
+	new_block->next = block->next;
+	if (block->next)
+		block->next->prev = new_block;
+	block->next = new_block;
+
+	// the miniblock of the compaction may have moved to the new block
+	if (arena->compact_block == block)
+		arena->compact_mb = NULL;
+
+	arena->count++;
+}
 
-	if (!node_find_b) {
+// deallocate a block/miniblock
+void free_block(arena_t *arena, const uint64_t address)
+{
+	block_t *block = search_block(arena, address);
+	if (!block) {
 		printf("Invalid address for free.\n");
 		return;
 	}
 
-	list_t *l = (list_t *)node_find_b->data_b->miniblock_list;
-	node *node_find_mb; long pos_mb = 0; // position of the miniblock
-	search_miniblock1(l, address, &node_find_mb, &pos_mb);
-
-	if (!node_find_mb) {
+	miniblock_t *mb = search_miniblock1(block, address);
+	if (!mb) {
 		printf("Invalid address for free.\n");
 		return;
 	}
 
-	size_t size_mb = node_find_mb->data_mb->size; uint64_t new_address;
-	if (!node_find_mb->next)
-		new_address = 0;
-	else
-		new_address = node_find_mb->next->data_mb->start_address;
-
-	remove_nth_node(l, node_find_mb, pos_mb, 2);
-
-	if (pos_mb == 1) { // remobe the miniblock from the beginning
-		node_find_b->data_b->start_address = new_address;
-		node_find_b->data_b->size -= size_mb;
-		arena->alloc_list->list_size -= size_mb;
-		if (l->size == 0) // the block has no more miniblocks
-			remove_nth_node(arena->alloc_list, node_find_b, pos_b, 1);
+	if (mb == block->head) { // remove the miniblock from the beginning
+		remove_miniblock(arena, block, mb);
+		if (block->count == 0) // the block has no more miniblocks
+			remove_block(arena, block);
+		else
+			block->start_address = block->head->start_address;
 		return;
 	}
 
-	if (pos_mb == (long)l->size + 1) { // remove the miniblock from the end
-		node_find_b->data_b->size -= size_mb;
-		arena->alloc_list->list_size -= size_mb;
+	if (mb == block->tail) { // remove the miniblock from the end
+		remove_miniblock(arena, block, mb);
 		return;
 	}
 
 	// ---- Remove the miniblock from the inside of the block ----
-	arena->alloc_list->list_size -= size_mb;
-	long x = pos_mb - 1; long y = l->size - pos_mb + 1;
-	size_t total_b1 = 0, total_b2 = 0;
-	node *curr = l->head;
-	while (x) {
-		total_b1 += curr->data_mb->size;
-		curr = curr->next;
-		x--;
-	}
-
-	total_b2 = node_find_b->data_b->size - total_b1 - size_mb;
-	l->size = pos_mb - 1; l->list_size = total_b1;
-
-	node_find_b->data_b->size = total_b1;
-
-	node *new_block = malloc(sizeof(*new_block));
-	new_block->data_b = malloc(sizeof(block_t));
-	new_block->data_b->start_address = curr->data_mb->start_address;
-	new_block->data_b->size = total_b2;
-
-	new_block->data_b->miniblock_list = create_list();
-	l = (list_t *)new_block->data_b->miniblock_list;
-	l->list_size = total_b2; l->head = curr; l->size = y;
-
-	curr->prev->next = NULL; curr->prev = NULL;
-	new_block->prev = node_find_b;
-	new_block->next = node_find_b->next;
-
-	if (node_find_b->next)
-		node_find_b->next->prev = new_block;
-	node_find_b->next = new_block;
-
-	arena->alloc_list->size++;
+	miniblock_t *next = mb->next;
+	remove_miniblock(arena, block, mb);
+	split_block(arena, block, next);
 }
 
-// verify if an address is the address of a miniblock
-void
-search_miniblock2(list_t *list, uint64_t address, node **node_find, long *pos)
+// return the miniblock that holds an address
+miniblock_t *search_miniblock2(block_t *block, uint64_t address)
 {
-	node *curr = list->head;
-	*node_find = NULL;
-	*pos = 0;
+	miniblock_t *curr = block->head;
 	while (curr) {
-		(*pos)++;
-		uint64_t start_address = curr->data_mb->start_address;
-		uint64_t dim = start_address + curr->data_mb->size;
-		if (address >= start_address && address < dim) {
-			*node_find = curr;
-			break;
-		}
+		uint64_t start_address = curr->start_address;
+		uint64_t dim = start_address + curr->size;
+		if (address >= start_address && address < dim)
+			return curr;
 		curr = curr->next;
 	}
+
+	return NULL;
 }
 
 void read(arena_t *arena, uint64_t address, uint64_t size)
 {
-	if (!arena->alloc_list) {
-		printf("Invalid address for read.\n");
-		return;
-	}
-
 	// ------------------ Find the address ------------------
-	node *node_find_b = NULL;
-	long pos_b;
-	search_block(arena->alloc_list, address, &node_find_b, &pos_b);
-
-	if (!node_find_b) {
+	block_t *block = search_block(arena, address);
+	if (!block) {
 		printf("Invalid address for read.\n");
 		return;
 	}
 
-	list_t *list = (list_t *)node_find_b->data_b->miniblock_list;
-	node *node_find_mb;
-	long pos_mb;
-	search_miniblock2(list, address, &node_find_mb, &pos_mb);
-
-	if (!node_find_mb) {
+	miniblock_t *mb = search_miniblock2(block, address);
+	if (!mb) {
 		printf("Invalid address for read.\n");
 		return;
 	}
 
 	// --------------- Verify the permissions ----------------
-	node *curr = node_find_mb;
-	uint64_t size_readable = 0;
-	while (curr && size_readable < size) {
-		size_readable += curr->data_mb->size;
-		int8_t perm = curr->data_mb->perm;
-		if (perm < 4) {
+	uint64_t block_size = block->start_address + block->size - address;
+	uint64_t n = size < block_size ? size : block_size;
+	miniblock_t *curr = mb;
+	do {
+		if (curr->perm < 4) {
 			printf("Invalid permissions for read.\n");
 			return;
 		}
-		if (!(curr->data_mb->rw_buffer) && size_readable <= size) {
-			printf("Invalid address for read.\n");
-			return;
-		}
 		curr = curr->next;
-	}
+	} while (curr && curr->start_address < address + n);
 
-	if (size_readable < size) {
-		size = size_readable;
+	if (block_size < size) {
 		printf("Warning: size was bigger than the block size. ");
-		printf("Reading %lu characters.\n", size);
+		printf("Reading %lu characters.\n", block_size);
 	}
 
-	size_readable = 0;
-
-	uint64_t start_read = address - node_find_mb->data_mb->start_address;
-	curr = node_find_mb;
-	while (curr) {
-		int8_t *buffer = (int8_t *)curr->data_mb->rw_buffer;
-		long n = curr->data_mb->size;
-		size_readable += n - start_read;
-		if (size_readable > size) {
-			n = n - (size_readable - size);
-			size_readable = n - start_read;
-		}
-		for (long i = start_read; i < n; i++)
-			printf("%c", buffer[i]);
-
-		if (size_readable == size) {
-			printf("\n");
-			return;
-		}
+	heat_range(arena, mb, address, n, 0);
 
-		curr = curr->next;
+	int8_t *buffer = malloc(n + 1);
+	if (!buffer) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
 	}
+	copy_from_miniblocks(mb, address, n, buffer);
+	fwrite(buffer, 1, n, stdout);
+	printf("\n");
+	free(buffer);
 }
 
 void read_characters(uint64_t size)
 {
-	while (size) {
-		getchar();
+	while (size && getchar() != EOF)
 		size--;
-	}
 }
 
-int8_t *text(arena_t *arena, const uint64_t address, const uint64_t size)
+// verify if a write is possible and find how many characters fit
+int check_write(arena_t *arena, const uint64_t address, const uint64_t size,
+				uint64_t *accepted)
 {
-	getchar();
-	if (!arena->alloc_list) {
-		printf("Invalid address for write.\n");
-		read_characters(size);
-		return NULL;
-	}
-
 	// ------------------ Find the address ------------------
-	node *node_find_b = NULL;
-	long pos_b;
-	search_block(arena->alloc_list, address, &node_find_b, &pos_b);
-
-	if (!node_find_b) {
+	block_t *block = search_block(arena, address);
+	if (!block) {
 		printf("Invalid address for write.\n");
-		read_characters(size);
-		return NULL;
+		return 0;
 	}
 
-	list_t *list = (list_t *)node_find_b->data_b->miniblock_list;
-	node *node_find_mb;
-	long pos_mb;
-	search_miniblock2(list, address, &node_find_mb, &pos_mb);
-
-	if (!node_find_mb) {
+	miniblock_t *mb = search_miniblock2(block, address);
+	if (!mb) {
 		printf("Invalid address for write.\n");
-		read_characters(size);
-		return NULL;
+		return 0;
 	}
 
 	// --------------- 	Veify the permissions ----------------
-	node *curr = node_find_mb;
-	uint64_t size_readable = 0;
-	while (curr && size_readable < size) {
-		size_readable += curr->data_mb->size;
-		int8_t perm = curr->data_mb->perm;
+	uint64_t block_size = block->start_address + block->size - address;
+	uint64_t n = size < block_size ? size : block_size;
+	miniblock_t *curr = mb;
+	do {
+		int8_t perm = curr->perm;
 		if (perm < 2 || perm == 4 || perm == 5) {
 			printf("Invalid permissions for write.\n");
-			read_characters(size);
-			return NULL;
+			return 0;
 		}
 		curr = curr->next;
-	}
-
-	size_readable = size;
-	uint64_t rest = 0;
-	uint64_t start_address = address - list->head->data_mb->start_address;
+	} while (curr && curr->start_address < address + n);
 
-	uint64_t block_size = node_find_b->data_b->size - start_address;
+	*accepted = size;
 	if (block_size < size) {
 		printf("Warning: size was bigger than the block size. ");
 		printf("Writing %lu characters.\n", block_size);
-		size_readable = block_size;
-		rest = size - size_readable;
+		*accepted = block_size;
+	}
+
+	return 1;
+}
+
+int8_t *text(arena_t *arena, const uint64_t address, const uint64_t size)
+{
+	getchar();
+	uint64_t size_readable;
+	if (!check_write(arena, address, size, &size_readable)) {
+		read_characters(size);
+		return NULL;
 	}
 
+	uint64_t rest = size - size_readable;
 	int8_t *buffer = malloc((size_readable + 1) * sizeof(int8_t));
 	long i = 0; char c;
 	while (size_readable) {
@@ -662,127 +901,1063 @@ write(arena_t *arena, const uint64_t address, const uint64_t size, int8_t *data)
 		return;
 
 	// ------------------ Find the address ------------------
-	node *node_find_b = NULL;
-	long pos_b;
-	search_block(arena->alloc_list, address, &node_find_b, &pos_b);
+	block_t *block = search_block(arena, address);
+	miniblock_t *mb = search_miniblock2(block, address);
 
-	list_t *list = (list_t *)node_find_b->data_b->miniblock_list;
-	node *node_find_mb;
-	long pos_mb;
-	search_miniblock2(list, address, &node_find_mb, &pos_mb);
+	heat_range(arena, mb, address, size, 1);
 
 	// writing the data
-	uint64_t size_data = size;
-	long n = size_data;
-	node *curr = node_find_mb;
-	uint64_t i = 0;
-	uint64_t start_address = address - node_find_mb->data_mb->start_address;
-	while (n > 0) {
-		uint64_t size_mb = curr->data_mb->size;
-		n -= size_mb - start_address;
-		int8_t *buffer = (int8_t *)curr->data_mb->rw_buffer;
-
-		for (uint64_t k = start_address; k < size_mb; k++) {
-			if (i + k > size_data)
-				break;
-			buffer[k] = data[i + k];
-		}
-
-		i += size_mb - start_address;
-		start_address = 0;
-		curr = curr->next;
-	}
+	copy_to_miniblocks(mb, address, size, data);
 }
 
 void printf_perm(int8_t perm)
+{
+	fprintf_perm(stdout, perm);
+}
+
+void fprintf_perm(FILE *out, int8_t perm)
 {
 	if (perm == 0)
-		printf("---\n");
+		fprintf(out, "---\n");
 	if (perm == 1)
-		printf("--X\n");
+		fprintf(out, "--X\n");
 	if (perm == 2)
-		printf("-W-\n");
+		fprintf(out, "-W-\n");
 	if (perm == 3)
-		printf("-WX\n");
+		fprintf(out, "-WX\n");
 	if (perm == 4)
-		printf("R--\n");
+		fprintf(out, "R--\n");
 	if (perm == 5)
-		printf("R-X\n");
+		fprintf(out, "R-X\n");
 	if (perm == 6)
-		printf("RW-\n");
+		fprintf(out, "RW-\n");
 	if (perm == 7)
-		printf("RWX\n");
+		fprintf(out, "RWX\n");
 }
 
-void pmap(const arena_t *arena)
+// display a block and its miniblocks; i is the number of the block
+void pmap_block(const block_t *block, uint64_t i)
+{
+	fpmap_block(stdout, block, i);
+}
+
+void fpmap_block(FILE *out, const block_t *block, uint64_t i)
+{
+	fprintf(out, "\nBlock %llu begin\n", (unsigned long long)i);
+
+	unsigned long long start_address, size;
+	start_address = (unsigned long long)block->start_address;
+	size = (unsigned long long)block->start_address + block->size;
+	fprintf(out, "Zone: 0x%llX - 0x%llX\n", start_address, size);
+
+	miniblock_t *curr = block->head;
+	unsigned long long j = 1;
+
+	while (curr) {
+		unsigned long long start_address, size;
+		start_address = (unsigned long long)curr->start_address;
+		size = (unsigned long long)start_address + curr->size;
+		fprintf(out, "Miniblock %llu:", j);
+		fprintf(out, "\t\t0x%llX\t\t-\t\t0x%llX\t\t| ", start_address, size);
+
+		// show the permissions of the miniblock
+		fprintf_perm(out, curr->perm);
+
+		curr = curr->next;
+		j++;
+	}
+	fprintf(out, "Block %llu end\n", (unsigned long long)i);
+}
+
+// display the blocks of a chunk of the list
+void pmap_chunk(FILE *out, const void *chunk)
+{
+	const pmap_chunk_t *c = chunk;
+	const block_t *curr = c->first;
+	for (uint64_t k = 0; k < c->count; k++) {
+		fpmap_block(out, curr, c->index + k);
+		curr = curr->next;
+	}
+}
+
+// display count blocks, from first (block number i); big maps are split
+// in chunks with about as many miniblocks, formatted in parallel
+void pmap_blocks(const block_t *first, uint64_t i, uint64_t count,
+				 uint64_t nr_minib)
+{
+	int threads = parallel_threads();
+	if (threads > 1 && nr_minib >= PMAP_PARALLEL_MINIBLOCKS) {
+		pmap_chunk_t chunks[PARALLEL_MAX_THREADS];
+		uint64_t share = nr_minib / threads + 1, mbs = 0;
+		int n = 0;
+
+		const block_t *curr = first;
+		for (uint64_t k = 0; k < count; k++) {
+			if (!n || mbs >= share) {
+				if (n == threads)
+					break;
+				chunks[n].first = curr;
+				chunks[n].index = i + k;
+				chunks[n].count = 0;
+				n++;
+				mbs = 0;
+			}
+			chunks[n - 1].count++;
+			mbs += curr->count;
+			curr = curr->next;
+		}
+
+		// the last chunk takes the blocks that are left
+		chunks[n - 1].count = count - (chunks[n - 1].index - i);
+		if (n > 1 && parallel_print(pmap_chunk, chunks, sizeof(*chunks), n))
+			return;
+	}
+
+	for (uint64_t k = 0; k < count; k++) {
+		pmap_block(first, i + k);
+		first = first->next;
+	}
+}
+
+// display the totals of the arena, at the beginning of every map
+void pmap_header(const arena_t *arena)
 {
 	// ------------------- Arena size -------------------------
 	unsigned long long arena_size = (unsigned long long)arena->arena_size;
 	printf("Total memory: 0x%llX bytes\n", arena_size);
 
-	// if there are no allocated blocks
-	if (!arena->alloc_list) {
-		printf("Free memory: 0x%llX bytes\n", arena_size);
-		printf("Number of allocated blocks: 0\n");
-		printf("Number of allocated miniblocks: 0\n");
-		return;
-	}
-
 	// --------------------- Free memory ---------------------------
 	unsigned long long free_mem;
-	free_mem = (unsigned long long)arena_size - arena->alloc_list->list_size;
+	free_mem = (unsigned long long)arena_size - arena->alloc_size;
 	printf("Free memory: 0x%llX bytes\n", free_mem);
 
 	// --------------- Number of allocated blocks ---------------------
-	unsigned long long size_list = (unsigned long long)arena->alloc_list->size;
+	unsigned long long size_list = (unsigned long long)arena->count;
 	printf("Number of allocated blocks: %llu\n", size_list);
 
-	// calculate the number of miniblocks
-	unsigned long long nr_minib = 0;
-	node *curr = arena->alloc_list->head;
-	while (curr) {
-		list_t *l = (list_t *)curr->data_b->miniblock_list;
-		nr_minib += (unsigned long long)l->size;
-		curr = curr->next;
-	}
-
 	// --------------- The number of allocated miniblocks ----------------
+	unsigned long long nr_minib = (unsigned long long)arena->mb_count;
 	printf("Number of allocated miniblocks: %llu\n", nr_minib);
+}
 
-	node *curr1, *curr2;
-	curr1 = arena->alloc_list->head;
-	unsigned long long i = 0;
+void pmap(const arena_t *arena)
+{
+	pmap_header(arena);
+	pmap_blocks(arena->head, 1, arena->count, arena->mb_count);
+}
 
-	while (curr1) {
+// display only the blocks that overlap the zone [start, end)
+void pmap_range(const arena_t *arena, uint64_t start, uint64_t end)
+{
+	pmap_header(arena);
+
+	// the blocks before the zone are only counted, to keep their numbers
+	block_t *curr = arena->head;
+	uint64_t i = 1;
+	while (curr && curr->start_address + curr->size <= start) {
+		curr = curr->next;
 		i++;
-		// display the current block
-		printf("\nBlock %llu begin\n", i);
+	}
 
-		list_t *l = (list_t *)curr1->data_b->miniblock_list;
-		unsigned long long start_address, size;
-		start_address = (unsigned long long)curr1->data_b->start_address;
-		size = (unsigned long long)curr1->data_b->start_address + l->list_size;
-		printf("Zone: 0x%llX - 0x%llX\n", start_address, size);
+	// the blocks in the zone and their miniblocks
+	const block_t *first = curr;
+	uint64_t count = 0, nr_minib = 0;
+	while (curr && curr->start_address < end) {
+		nr_minib += curr->count;
+		count++;
+		curr = curr->next;
+	}
 
-		curr2 = l->head;
-		unsigned long long j = 1;
+	pmap_blocks(first, i, count, nr_minib);
+}
 
-		while (curr2) {
-			unsigned long long start_address, size;
-			start_address = (unsigned long long)curr2->data_mb->start_address;
-			size = (unsigned long long)start_address + curr2->data_mb->size;
-			printf("Miniblock %llu:", j);
-			printf("\t\t0x%llX\t\t-\t\t0x%llX\t\t| ", start_address, size);
+// display the totals of the arena on one line, in key=value format
+void pmap_summary(arena_t *arena)
+{
+	unsigned long long total = (unsigned long long)arena->arena_size;
+	unsigned long long free_mem = total - arena->alloc_size;
+	unsigned long long gap = (unsigned long long)largest_gap(arena);
+	unsigned long long blocks = (unsigned long long)arena->count;
+	unsigned long long nr_minib = (unsigned long long)arena->mb_count;
+
+	printf("total=%llu free=%llu largest_gap=%llu ", total, free_mem, gap);
+	printf("blocks=%llu miniblocks=%llu\n", blocks, nr_minib);
+}
 
-			// show the permissions of the miniblock
-			printf_perm(curr2->data_mb->perm);
+// order the segments of a vectored command by address; the ones at the
+// same address keep the order of the command, so the error reported for
+// them does not depend on qsort
+int compare_segments(const void *a, const void *b)
+{
+	const segment_t *s1 = (const segment_t *)a;
+	const segment_t *s2 = (const segment_t *)b;
 
-			curr2 = curr2->next;
-			j++;
-		}
-		printf("Block %llu end\n", i);
-		curr1 = curr1->next;
-	}
+	if (s1->address != s2->address)
+		return s1->address < s2->address ? -1 : 1;
+	if (s1->index != s2->index)
+		return s1->index < s2->index ? -1 : 1;
+	return 0;
+}
+
+// order the segments of a vectored command as they were given
+int compare_index(const void *a, const void *b)
+{
+	const segment_t *s1 = (const segment_t *)a;
+	const segment_t *s2 = (const segment_t *)b;
+
+	if (s1->index != s2->index)
+		return s1->index < s2->index ? -1 : 1;
+	return 0;
+}
+
+// find the miniblocks of all the segments with one sweep of the block list;
+// return 0 on success, 1 for an invalid address and 2 for a permission
+// that is missing (mask is 4 for read and 2 for write)
+int resolve_segments(arena_t *arena, segment_t *segments, long n, int mask)
+{
+	// the data of each segment keeps the order from the command
+	uint64_t offset = 0;
+	for (long i = 0; i < n; i++) {
+		segments[i].index = i;
+		segments[i].offset = offset;
+		offset += segments[i].size;
+	}
+	qsort(segments, n, sizeof(segment_t), compare_segments);
+
+	block_t *curr_b = arena->head;
+	miniblock_t *curr_mb = NULL;
+	for (long i = 0; i < n; i++) {
+		uint64_t address = segments[i].address;
+
+		// the blocks and the miniblocks are only walked forward
+		while (curr_b && curr_b->start_address + curr_b->size <= address) {
+			curr_b = curr_b->next;
+			curr_mb = NULL;
+		}
+
+		if (!curr_b || address < curr_b->start_address)
+			return 1;
+
+		// compared without computing the end, which could wrap around
+		if (segments[i].size > curr_b->start_address + curr_b->size - address)
+			return 1;
+		uint64_t dim = address + segments[i].size;
+
+		if (!curr_mb)
+			curr_mb = curr_b->head;
+		while (curr_mb->start_address + curr_mb->size <= address)
+			curr_mb = curr_mb->next;
+		segments[i].mb = curr_mb;
+
+		// every miniblock touched by the segment must allow the access
+		miniblock_t *curr = curr_mb;
+		do {
+			if (!(curr->perm & mask))
+				return 2;
+			curr = curr->next;
+		} while (curr && curr->start_address < dim);
+	}
+
+	return 0;
+}
+
+// copy size bytes of a zone that starts inside a miniblock
+void copy_from_miniblocks(miniblock_t *mb, uint64_t address, uint64_t size,
+						  int8_t *dest)
+{
+	uint64_t start = address - mb->start_address;
+	while (size) {
+		uint64_t n = mb->size - start;
+		if (n > size)
+			n = size;
+		memcpy(dest, (int8_t *)mb->rw_buffer + start, n);
+		dest += n;
+		size -= n;
+		start = 0;
+		mb = mb->next;
+	}
+}
+
+// copy size bytes into a zone that starts inside a miniblock
+void copy_to_miniblocks(miniblock_t *mb, uint64_t address, uint64_t size,
+						const int8_t *src)
+{
+	uint64_t start = address - mb->start_address;
+	while (size) {
+		uint64_t n = mb->size - start;
+		if (n > size)
+			n = size;
+		memcpy((int8_t *)mb->rw_buffer + start, src, n);
+		if (start + n > dirty_size(mb))
+			set_dirty(mb, start + n);
+		src += n;
+		size -= n;
+		start = 0;
+		mb = mb->next;
+	}
+}
+
+// read several zones at once, each one on its own line
+void read_vector(arena_t *arena, segment_t *segments, long n)
+{
+	int ret = resolve_segments(arena, segments, n, 4);
+	if (ret == 1) {
+		printf("Invalid address for readv.\n");
+		return;
+	}
+	if (ret == 2) {
+		printf("Invalid permissions for readv.\n");
+		return;
+	}
+
+	// every segment is followed by a new line in the output
+	uint64_t total = n;
+	for (long i = 0; i < n && total != UINT64_MAX; i++) {
+		if (segments[i].size > UINT64_MAX - total)
+			total = UINT64_MAX;
+		else
+			total += segments[i].size;
+	}
+
+	int8_t *output = NULL;
+	if (total < SIZE_MAX)
+		output = malloc(total);
+	if (!output) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+
+	for (long i = 0; i < n; i++) {
+		int8_t *dest = output + segments[i].offset + segments[i].index;
+		heat_range(arena, segments[i].mb, segments[i].address,
+				   segments[i].size, 0);
+		copy_from_miniblocks(segments[i].mb, segments[i].address,
+							 segments[i].size, dest);
+		dest[segments[i].size] = '\n';
+	}
+
+	fwrite(output, 1, total, stdout);
+	free(output);
+}
+
+// verify if a vectored write is possible
+int check_vector(arena_t *arena, segment_t *segments, long n)
+{
+	int ret = resolve_segments(arena, segments, n, 2);
+	if (ret == 1)
+		printf("Invalid address for writev.\n");
+	if (ret == 2)
+		printf("Invalid permissions for writev.\n");
+
+	return ret == 0;
+}
+
+// read the data of a vectored write after the segments are verified
+int8_t *text_vector(arena_t *arena, segment_t *segments, long n)
+{
+	getchar();
+	uint64_t total = 0;
+	for (long i = 0; i < n; i++)
+		total += segments[i].size;
+
+	if (!check_vector(arena, segments, n)) {
+		read_characters(total);
+		return NULL;
+	}
+
+	int8_t *buffer = malloc(total + 1);
+	if (!buffer) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		read_characters(total);
+		return NULL;
+	}
+
+	if (fread(buffer, 1, total, stdin) != total) {
+		free(buffer);
+		return NULL;
+	}
+	buffer[total] = '\0';
+
+	return buffer;
+}
+
+// write several zones at once, the segments must be resolved before
+void write_vector(arena_t *arena, segment_t *segments, long n,
+				  const int8_t *data)
+{
+	if (!data)
+		return;
+
+	// where the segments overlap, the last one of the command is kept
+	qsort(segments, n, sizeof(segment_t), compare_index);
+	for (long i = 0; i < n; i++) {
+		heat_range(arena, segments[i].mb, segments[i].address,
+				   segments[i].size, 1);
+		copy_to_miniblocks(segments[i].mb, segments[i].address,
+						   segments[i].size, data + segments[i].offset);
+	}
+}
+
+// find the first free zone of the arena that can hold size bytes
+int find_free_zone(arena_t *arena, uint64_t size, uint64_t *address)
+{
+	uint64_t end = 0;
+	block_t *curr = arena->head;
+
+	while (curr) {
+		if (curr->start_address - end >= size) {
+			*address = end;
+			return 1;
+		}
+		end = curr->start_address + curr->size;
+		curr = curr->next;
+	}
+
+	if (end <= arena->arena_size && arena->arena_size - end >= size) {
+		*address = end;
+		return 1;
+	}
+	return 0;
+}
+
+// move a miniblock to the first free zone that can hold new_size bytes
+void move_miniblock(arena_t *arena, miniblock_t *mb, uint64_t new_size)
+{
+	uint64_t address = mb->start_address, new_address;
+	if (!find_free_zone(arena, new_size, &new_address)) {
+		printf("Not enough space to resize.\n");
+		return;
+	}
+
+	void *buffer = buffer_resize(&arena->cache, mb->rw_buffer, mb->size,
+								 new_size, dirty_size(mb));
+	if (!buffer) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+
+	// the buffer is detached so that it survives the free
+	uint64_t dirty = dirty_size(mb) < new_size ? dirty_size(mb) : new_size;
+	uint8_t perm = mb->perm;
+	mb->rw_buffer = NULL;
+	free_block(arena, address);
+	alloc_block(arena, new_address, new_size);
+
+	// the new miniblock receives the old buffer instead of a clean one
+	block_t *block = search_block(arena, new_address);
+	mb = search_miniblock1(block, new_address);
+	buffer_put(&arena->cache, mb->rw_buffer, mb->size, 0);
+	mb->rw_buffer = buffer;
+	set_dirty(mb, dirty);
+	mb->perm = perm;
+
+	printf("Miniblock moved to 0x%llX.\n", (unsigned long long)new_address);
+}
+
+// change the size of a miniblock without reallocating it
+void resize(arena_t *arena, uint64_t address, uint64_t new_size, int move)
+{
+	// ------------------ Find the address ------------------
+	block_t *block = search_block(arena, address);
+	if (!block) {
+		printf("Invalid address for resize.\n");
+		return;
+	}
+
+	miniblock_t *mb = search_miniblock1(block, address);
+	if (!mb) {
+		printf("Invalid address for resize.\n");
+		return;
+	}
+
+	if (new_size == 0) {
+		printf("Invalid size for resize.\n");
+		return;
+	}
+
+	if (new_size == mb->size)
+		return;
+
+	// the other mappings would lose their buffer
+	if (miniblock_shared(mb)) {
+		printf("Mapped miniblocks cannot be resized.\n");
+		return;
+	}
+
+	// ------------------ Shrink the miniblock ------------------
+	if (new_size < mb->size) {
+		uint64_t delta = mb->size - new_size;
+		void *buffer = buffer_resize(&arena->cache, mb->rw_buffer, mb->size,
+									 new_size, dirty_size(mb));
+		if (!buffer) {
+			fprintf(stderr, "This zone could not be allocated\n");
+			return;
+		}
+
+		gap_release(arena, block, address + new_size, delta);
+		mb->rw_buffer = buffer;
+		mb->size = new_size;
+		heat_reset_pages(mb);
+		if (dirty_size(mb) > new_size)
+			set_dirty(mb, new_size);
+		block->size -= delta;
+		arena->alloc_size -= delta;
+
+		// a gap appears inside the block, so the block is split
+		if (mb->next)
+			split_block(arena, block, mb->next);
+		return;
+	}
+
+	// ------------------ Grow the miniblock ------------------
+	uint64_t delta = new_size - mb->size;
+	uint64_t dim = address + new_size;
+	block_t *next = block->next;
+
+	int in_place = !mb->next && dim <= arena->arena_size;
+	if (next && dim > next->start_address)
+		in_place = 0;
+
+	if (!in_place) {
+		if (move)
+			move_miniblock(arena, mb, new_size);
+		else if (dim > arena->arena_size)
+			printf("The end address is past the size of the arena\n");
+		else
+			printf("This zone was already allocated.\n");
+		return;
+	}
+
+	void *buffer = buffer_resize(&arena->cache, mb->rw_buffer, mb->size,
+								 new_size, dirty_size(mb));
+	if (!buffer) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+
+	mb->rw_buffer = buffer;
+	mb->size = new_size;
+	heat_reset_pages(mb);
+	block->size += delta;
+	arena->alloc_size += delta;
+	gap_fill(arena, block, dim - delta, delta);
+
+	// the block reached the next one, so they are chained
+	if (next && dim == next->start_address)
+		chain_block(arena, block);
+}
+
+// map the buffer of the miniblock that starts at source_address (in the
+// source arena) at another address, without copying it
+void map_shared(arena_t *arena, uint64_t address, uint64_t size,
+				arena_t *source, uint64_t source_address)
+{
+	block_t *block = source ? search_block(source, source_address) : NULL;
+	miniblock_t *src = block ? search_miniblock1(block, source_address) : NULL;
+	if (!src) {
+		printf("Invalid address for map.\n");
+		return;
+	}
+
+	if (size == 0 || size > src->size) {
+		printf("Invalid size for map.\n");
+		return;
+	}
+
+	// the miniblock is placed like any other one (alloc_block explains
+	// why it could not be)
+	uint64_t count = arena->mb_count;
+	alloc_block(arena, address, size);
+	if (arena->mb_count == count)
+		return;
+
+	miniblock_t *mb = search_miniblock1(search_block(arena, address), address);
+	if (!miniblock_ext(src) || !miniblock_ext(mb)) {
+		trim_ext(src);
+		trim_ext(mb);
+		return;
+	}
+
+	buffer_ref_t *ref = buffer_share(src->ext->shared, src->rw_buffer,
+									 src->size);
+	if (!ref) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		trim_ext(src);
+		trim_ext(mb);
+		return;
+	}
+	src->ext->shared = ref;
+
+	// the new miniblock receives the shared buffer instead of a clean one
+	buffer_put(&arena->cache, mb->rw_buffer, mb->size, 0);
+	mb->rw_buffer = src->rw_buffer;
+	mb->dirty = 0;
+	mb->ext->shared = ref;
+}
+
+// create a miniblock whose buffer is a mapping of a file
+void map_file(arena_t *arena, uint64_t address, const char *path,
+			  uint64_t offset, uint64_t length, int shared)
+{
+	if (length == 0) {
+		printf("Invalid size for map.\n");
+		return;
+	}
+
+	buffer_ref_t *ref = buffer_map_file(path, offset, length, shared);
+	if (!ref) {
+		printf("Invalid file for map.\n");
+		return;
+	}
+
+	uint64_t count = arena->mb_count;
+	alloc_block(arena, address, length);
+	if (arena->mb_count == count) {
+		buffer_unshare(NULL, ref);
+		return;
+	}
+
+	// the kernel loads the pages of the file when they are accessed
+	miniblock_t *mb = search_miniblock1(search_block(arena, address), address);
+	if (!miniblock_ext(mb)) {
+		buffer_unshare(NULL, ref);
+		return;
+	}
+	buffer_put(&arena->cache, mb->rw_buffer, mb->size, 0);
+	mb->rw_buffer = ref->buffer;
+	mb->dirty = 0;
+	mb->ext->shared = ref;
+}
+
+// write the changes of a miniblock mapped from a file to the file
+void sync_mapping(arena_t *arena, uint64_t address)
+{
+	block_t *block = search_block(arena, address);
+	miniblock_t *mb = block ? search_miniblock1(block, address) : NULL;
+	// a private mapping is a copy, its changes never reach the file
+	buffer_ref_t *ref = mb ? miniblock_shared(mb) : NULL;
+	if (!ref || !ref->map || !ref->map_shared) {
+		printf("Invalid address for sync.\n");
+		return;
+	}
+
+	if (!buffer_sync(ref))
+		printf("The file could not be synced.\n");
+}
+
+// merge a miniblock with the one that follows it in the block
+void merge_miniblocks(arena_t *arena, block_t *block, miniblock_t *mb)
+{
+	miniblock_t *next = mb->next;
+	uint64_t size = mb->size + next->size;
+
+	void *buffer = buffer_resize(&arena->cache, mb->rw_buffer, mb->size,
+								 size, dirty_size(mb));
+	if (!buffer) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+
+	// only the bytes that could have been written are copied
+	uint64_t dirty = dirty_size(next);
+	memcpy((int8_t *)buffer + mb->size, next->rw_buffer, dirty);
+	if (dirty)
+		set_dirty(mb, mb->size + dirty);
+	mb->rw_buffer = buffer;
+	mb->size = size;
+	heat_merge(mb, next);
+
+	mb->next = next->next;
+	if (next->next)
+		next->next->prev = mb;
+	else
+		block->tail = mb;
+	block->count--;
+	frag_block(arena, block->count + 1, block->count);
+	arena->mb_count--;
+	if (arena->compact_mb == next)
+		arena->compact_mb = mb;
+
+	buffer_put(&arena->cache, next->rw_buffer, next->size, dirty);
+	heat_reset_pages(next);
+	meta_free(arena, miniblock_pool, next);
+}
+
+// mark a zone of the arena to be compacted by the next steps
+void schedule_compact(arena_t *arena, uint64_t start, uint64_t end)
+{
+	if (!arena->compacting) {
+		arena->compacting = 1;
+		arena->compact_start = start;
+		arena->compact_end = end;
+		return;
+	}
+
+	if (start < arena->compact_start) {
+		arena->compact_start = start;
+		arena->compact_block = NULL;
+		arena->compact_mb = NULL;
+	}
+	if (end > arena->compact_end)
+		arena->compact_end = end;
+}
+
+// start an automatic compaction if a block has too many miniblocks
+void check_compact(arena_t *arena, block_t *block)
+{
+	if (arena->compact_threshold && block->count > arena->compact_threshold)
+		schedule_compact(arena, block->start_address,
+						 block->start_address + block->size);
+}
+
+// merge a bounded number of miniblocks from the zone that is compacted,
+// so that a big compaction is spread over many commands; every block and
+// miniblock looked at counts, and the next step continues from there
+void compact_step(arena_t *arena)
+{
+	if (!arena->compacting)
+		return;
+
+	uint64_t merges = 0, bytes = 0, visits = 0;
+	block_t *block = arena->compact_block;
+	miniblock_t *mb = arena->compact_mb;
+	if (!block) {
+		block = arena->head;
+		mb = NULL;
+	}
+
+	while (block && block->start_address < arena->compact_end) {
+		if (!mb)
+			mb = block->head;
+
+		// the blocks before the zone are only passed
+		if (block->start_address + block->size <= arena->compact_start)
+			mb = NULL;
+
+		while (mb && mb->next && mb->start_address < arena->compact_end) {
+			if (merges == COMPACT_STEP || bytes >= COMPACT_STEP_BYTES ||
+				visits >= COMPACT_STEP_VISITS) {
+				// continue from this miniblock at the next step
+				if (mb->start_address > arena->compact_start)
+					arena->compact_start = mb->start_address;
+				arena->compact_block = block;
+				arena->compact_mb = mb;
+				return;
+			}
+
+			visits++;
+			if (mb->start_address + mb->size <= arena->compact_start ||
+				mb->perm != mb->next->perm || miniblock_shared(mb) ||
+				miniblock_shared(mb->next)) {
+				mb = mb->next;
+				continue;
+			}
+
+			bytes += dirty_size(mb) + dirty_size(mb->next);
+			merge_miniblocks(arena, block, mb);
+			merges++;
+		}
+
+		block = block->next;
+		mb = NULL;
+		if (block && ++visits >= COMPACT_STEP_VISITS) {
+			if (block->start_address > arena->compact_start)
+				arena->compact_start = block->start_address;
+			arena->compact_block = block;
+			arena->compact_mb = NULL;
+			return;
+		}
+	}
+
+	arena->compacting = 0;
+	arena->compact_block = NULL;
+	arena->compact_mb = NULL;
+}
+
+// merge the adjacent miniblocks with the same permissions, of a block
+// or of the whole arena
+void compact(arena_t *arena, int all, uint64_t address)
+{
+	if (all) {
+		schedule_compact(arena, 0, UINT64_MAX);
+		return;
+	}
+
+	block_t *block = search_block(arena, address);
+	if (!block) {
+		printf("Invalid address for compact.\n");
+		return;
+	}
+
+	schedule_compact(arena, block->start_address,
+					 block->start_address + block->size);
+}
+
+// change the number of miniblocks from which a block is compacted
+void compact_auto(arena_t *arena, uint64_t threshold)
+{
+	arena->compact_threshold = threshold;
+}
+
+#if VMA_HEATMAP
+// apply the decays that were missed since the last access of a miniblock
+void heat_sync(arena_t *arena, miniblock_t *mb)
+{
+	unsigned int delta = (arena->heat_epoch - mb->heat_epoch) &
+						 HEAT_EPOCH_MASK;
+	if (!delta)
+		return;
+
+	int shift = delta < 8 ? delta : 8;
+	mb->heat_read >>= shift;
+	mb->heat_write >>= shift;
+	uint8_t *page_heat = miniblock_page_heat(mb);
+	if (page_heat) {
+		uint64_t pages = (mb->size + HEAT_PAGE - 1) / HEAT_PAGE;
+		for (uint64_t i = 0; i < pages; i++)
+			page_heat[i] >>= shift;
+	}
+	mb->heat_epoch = arena->heat_epoch;
+}
+
+// count an access to the zone [address, address + size)
+void heat_range(arena_t *arena, miniblock_t *mb, uint64_t address,
+				uint64_t size, int write)
+{
+	// the counters of the arena get older after every period
+	arena->heat_accesses++;
+	if (arena->heat_accesses % HEAT_DECAY_PERIOD == 0)
+		arena->heat_epoch++;
+
+	uint64_t dim = address + size;
+	while (mb && mb->start_address < dim) {
+		heat_sync(arena, mb);
+		if (write && mb->heat_write < UINT8_MAX)
+			mb->heat_write++;
+		if (!write && mb->heat_read < UINT8_MAX)
+			mb->heat_read++;
+
+		// the pages of a big miniblock are counted separately
+		if (mb->size > HEAT_PAGE) {
+			uint64_t pages = (mb->size + HEAT_PAGE - 1) / HEAT_PAGE;
+			uint8_t *page_heat = miniblock_page_heat(mb);
+			if (!page_heat && miniblock_ext(mb)) {
+				page_heat = calloc(pages, sizeof(uint8_t));
+				mb->ext->page_heat = page_heat;
+				trim_ext(mb);
+			}
+
+			uint64_t first = 0, last = mb->size;
+			if (address > mb->start_address)
+				first = address - mb->start_address;
+			if (dim < mb->start_address + mb->size)
+				last = dim - mb->start_address;
+
+			for (uint64_t i = first / HEAT_PAGE;
+				 page_heat && i * HEAT_PAGE < last; i++)
+				if (page_heat[i] < UINT8_MAX)
+					page_heat[i]++;
+		}
+		mb = mb->next;
+	}
+}
+
+// forget the counters of the pages (the miniblock changed its size)
+void heat_reset_pages(miniblock_t *mb)
+{
+	if (!mb->ext)
+		return;
+	free(mb->ext->page_heat);
+	mb->ext->page_heat = NULL;
+	trim_ext(mb);
+}
+
+// add the counters of a miniblock to the one it is merged with
+void heat_merge(miniblock_t *mb, miniblock_t *next)
+{
+	unsigned int heat_read = mb->heat_read + next->heat_read;
+	unsigned int heat_write = mb->heat_write + next->heat_write;
+	mb->heat_read = heat_read < UINT8_MAX ? heat_read : UINT8_MAX;
+	mb->heat_write = heat_write < UINT8_MAX ? heat_write : UINT8_MAX;
+	heat_reset_pages(mb);
+}
+
+// order the zones of the heatmap from the hottest to the coldest
+int compare_heat(const void *a, const void *b)
+{
+	const heat_zone_t *z1 = (const heat_zone_t *)a;
+	const heat_zone_t *z2 = (const heat_zone_t *)b;
+
+	if (z1->heat != z2->heat)
+		return z1->heat > z2->heat ? -1 : 1;
+	if (z1->start_address != z2->start_address)
+		return z1->start_address < z2->start_address ? -1 : 1;
+	return 0;
+}
+#endif
+
+// show the n hottest and coldest zones and the heat of the arena
+// split in equal buckets
+void heatmap(arena_t *arena, uint64_t n)
+{
+#if VMA_HEATMAP
+	// ------------------ Collect the zones ------------------
+	uint64_t nr_zones = 0, i = 0;
+	for (block_t *b = arena->head; b; b = b->next)
+		for (miniblock_t *mb = b->head; mb; mb = mb->next)
+			nr_zones += miniblock_page_heat(mb) ?
+						(mb->size + HEAT_PAGE - 1) / HEAT_PAGE : 1;
+
+	heat_zone_t *zones = malloc((nr_zones + 1) * sizeof(heat_zone_t));
+	if (!zones) {
+		fprintf(stderr, "This zone could not be allocated\n");
+		return;
+	}
+
+	for (block_t *b = arena->head; b; b = b->next) {
+		for (miniblock_t *mb = b->head; mb; mb = mb->next) {
+			heat_sync(arena, mb);
+			uint8_t *page_heat = miniblock_page_heat(mb);
+			if (!page_heat) {
+				zones[i].start_address = mb->start_address;
+				zones[i].size = mb->size;
+				zones[i].heat = mb->heat_read + mb->heat_write;
+				i++;
+				continue;
+			}
+			for (uint64_t off = 0; off < mb->size; off += HEAT_PAGE) {
+				zones[i].start_address = mb->start_address + off;
+				zones[i].size = mb->size - off < HEAT_PAGE ? mb->size - off
+														   : HEAT_PAGE;
+				zones[i].heat = page_heat[off / HEAT_PAGE];
+				i++;
+			}
+		}
+	}
+
+	qsort(zones, nr_zones, sizeof(heat_zone_t), compare_heat);
+	if (n > nr_zones)
+		n = nr_zones;
+
+	// ------------------ Hottest and coldest zones ------------------
+	printf("Hottest zones:\n");
+	for (i = 0; i < n; i++)
+		printf("0x%llX - 0x%llX\t\theat %u\n",
+			   (unsigned long long)zones[i].start_address,
+			   (unsigned long long)(zones[i].start_address + zones[i].size),
+			   zones[i].heat);
+
+	printf("Coldest zones:\n");
+	for (i = 0; i < n; i++) {
+		heat_zone_t *z = &zones[nr_zones - 1 - i];
+		printf("0x%llX - 0x%llX\t\theat %u\n",
+			   (unsigned long long)z->start_address,
+			   (unsigned long long)(z->start_address + z->size), z->heat);
+	}
+
+	// ------------------ Histogram of the arena ------------------
+	unsigned long long buckets[HEAT_BUCKETS] = {0};
+	uint64_t bucket_size = arena->arena_size / HEAT_BUCKETS;
+	if (!bucket_size)
+		bucket_size = 1;
+	for (i = 0; i < nr_zones; i++) {
+		uint64_t k = zones[i].start_address / bucket_size;
+		if (k >= HEAT_BUCKETS)
+			k = HEAT_BUCKETS - 1;
+		buckets[k] += zones[i].heat;
+	}
+
+	printf("Histogram:\n");
+	for (int k = 0; k < HEAT_BUCKETS; k++) {
+		unsigned long long start = (unsigned long long)k * bucket_size;
+		unsigned long long end = start + bucket_size;
+		if (k == HEAT_BUCKETS - 1)
+			end = arena->arena_size;
+		printf("0x%llX - 0x%llX\t\theat %llu\n", start, end, buckets[k]);
+	}
+
+	free(zones);
+#else
+	(void)arena;
+	(void)n;
+	printf("Heatmap support is disabled.\n");
+#endif
+}
+
+// show how the buffer cache has been used
+void cache_stats(const arena_t *arena)
+{
+	const buffer_cache_t *cache = &arena->cache;
+	unsigned long long hits = cache->hits, misses = cache->misses;
+	double rate = 0;
+	if (hits + misses)
+		rate = 100.0 * hits / (hits + misses);
+
+	printf("Cache hits: %llu\n", hits);
+	printf("Cache misses: %llu\n", misses);
+	printf("Hit rate: %.2f%%\n", rate);
+	printf("Cached buffers: %llu\n", (unsigned long long)cache->cached_buffers);
+	printf("Cached memory: 0x%llX bytes\n",
+		   (unsigned long long)cache->cached_bytes);
+	printf("Cache limit: 0x%llX bytes\n", (unsigned long long)cache->max_bytes);
+	printf("Evictions: %llu\n", (unsigned long long)cache->evictions);
+}
+
+// change the number of bytes the buffer cache can keep
+void cache_limit(arena_t *arena, uint64_t max_bytes)
+{
+	buffer_cache_limit(&arena->cache, max_bytes);
+}
+
+// show how much memory is used for the description of the blocks
+void metadata(const arena_t *arena)
+{
+	unsigned long long nr_minib = (unsigned long long)arena->mb_count;
+
+	unsigned long long total;
+	total = (unsigned long long)arena->count * sizeof(block_t);
+	total += nr_minib * sizeof(miniblock_t);
+
+	printf("Block metadata: %zu bytes\n", sizeof(block_t));
+	printf("Miniblock metadata: %zu bytes\n", sizeof(miniblock_t));
+	printf("Total metadata: 0x%llX bytes\n", total);
+	if (nr_minib)
+		printf("Metadata per miniblock: %.2f bytes\n",
+			   (double)total / nr_minib);
+	else
+		printf("Metadata per miniblock: 0 bytes\n");
+}
+
+// display the distribution of the free zones and of the miniblocks, from
+// the counters kept by the gap and block hooks (O(buckets))
+void frag(const arena_t *arena)
+{
+	unsigned long long free_mem = arena->arena_size - arena->alloc_size;
+	unsigned long long largest = (unsigned long long)arena->largest_gap;
+	unsigned long long gaps = (unsigned long long)arena->gap_count;
+
+	printf("Free memory: 0x%llX bytes in %llu zones\n", free_mem, gaps);
+	printf("Largest free zone: 0x%llX bytes\n", largest);
+
+	// the part of the free memory that a single allocation cannot use
+	double external = 0;
+	if (free_mem)
+		external = 100.0 * (free_mem - largest) / free_mem;
+	printf("External fragmentation: %.2f%%\n", external);
+
+	printf("Free zones by size:\n");
+	for (int i = 0; i < FRAG_BUCKETS; i++)
+		if (arena->gap_hist[i])
+			printf("0x%llX - 0x%llX: %llu\n", 1ULL << i,
+				   i < 63 ? (2ULL << i) - 1 : UINT64_MAX,
+				   (unsigned long long)arena->gap_hist[i]);
+
+	printf("Blocks by number of miniblocks:\n");
+	for (int i = 0; i < FRAG_BUCKETS; i++)
+		if (arena->block_hist[i])
+			printf("%llu - %llu: %llu\n", 1ULL << i,
+				   i < 63 ? (2ULL << i) - 1 : UINT64_MAX,
+				   (unsigned long long)arena->block_hist[i]);
 }
 
 int permissions_cases(char *s)
@@ -804,39 +1979,27 @@ int permissions_cases(char *s)
 // change the permissions of a miniblock
 void mprotect(arena_t *arena, uint64_t address, int8_t *permission)
 {
-	if (!arena->alloc_list) {
-		printf("Invalid address for mprotect.\n");
-		return;
-	}
-
 	// ------------------ Se cauta adresa ------------------
-	node *node_find_b = NULL;
-	long pos_b;
-	search_block(arena->alloc_list, address, &node_find_b, &pos_b);
-
-	if (!node_find_b) {
+	block_t *block = search_block(arena, address);
+	if (!block) {
 		printf("Invalid address for mprotect.\n");
 		return;
 	}
 
-	list_t *list = (list_t *)node_find_b->data_b->miniblock_list;
-	node *node_find_mb;
-	long pos_mb;
-	search_miniblock1(list, address, &node_find_mb, &pos_mb);
-
-	if (!node_find_mb) {
+	miniblock_t *mb = search_miniblock1(block, address);
+	if (!mb) {
 		printf("Invalid address for mprotect.\n");
 		return;
 	}
 
 	char *p = strtok((char *)permission, " |");
-	node_find_mb->data_mb->perm = 0;
+	mb->perm = 0;
 	while (p) {
 		int perm = permissions_cases(p);
 		if (perm == 0)
-			node_find_mb->data_mb->perm = 0;
+			mb->perm = 0;
 		else
-			node_find_mb->data_mb->perm += perm;
+			mb->perm |= perm;
 		p = strtok(NULL, " |");
 	}
 }
@@ -867,5 +2030,50 @@ int convert(char s[])
 	if (strcmp(s, "MPROTECT") == 0)
 		return 8;
 
+	if (strcmp(s, "CACHE_STATS") == 0)
+		return 9;
+
+	if (strcmp(s, "CACHE_LIMIT") == 0)
+		return 10;
+
+	if (strcmp(s, "RESIZE") == 0)
+		return 11;
+
+	if (strcmp(s, "READV") == 0)
+		return 12;
+
+	if (strcmp(s, "WRITEV") == 0)
+		return 13;
+
+	if (strcmp(s, "METADATA") == 0)
+		return 14;
+
+	if (strcmp(s, "COMPACT") == 0)
+		return 15;
+
+	if (strcmp(s, "COMPACT_AUTO") == 0)
+		return 16;
+
+	if (strcmp(s, "HEATMAP") == 0)
+		return 17;
+
+	if (strcmp(s, "ATTACH") == 0)
+		return 18;
+
+	if (strcmp(s, "PMAP_SUMMARY") == 0)
+		return 19;
+
+	if (strcmp(s, "MAP_SHARED") == 0)
+		return 20;
+
+	if (strcmp(s, "MAP_FILE") == 0)
+		return 21;
+
+	if (strcmp(s, "SYNC") == 0)
+		return 22;
+
+	if (strcmp(s, "FRAG") == 0)
+		return 23;
+
 	return -1;
 }
@@ -6,83 +6,252 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include "buffer.h"
+#include "policy.h"
+#include "pool.h"
+#include "reclaim.h"
+#include "parallel.h"
+
+// build with -DVMA_HEATMAP=0 to leave out the access counters
+#ifndef VMA_HEATMAP
+#define VMA_HEATMAP 1
+#endif
+
+// miniblocks bigger than a page also count the accesses of each page
+#define HEAT_PAGE 4096
+// bits of the epoch kept by a miniblock (it shares a word with perm)
+#define HEAT_EPOCH_BITS 13
+#define HEAT_EPOCH_MASK ((1u << HEAT_EPOCH_BITS) - 1)
+// the counters are halved after this many accesses in the arena
+#define HEAT_DECAY_PERIOD 1024
+#define HEAT_BUCKETS 16
+
+// the mark of the written bytes saturates here: the whole buffer of the
+// miniblock is considered written
+#define DIRTY_MAX UINT32_MAX
 
 typedef struct block_t block_t;
 typedef struct miniblock_t miniblock_t;
-typedef struct node node;
-
-struct node {
-	node *next, *prev;
-	union {
-		block_t *data_b;
-		miniblock_t *data_mb;
-	};
-};
 
+// the fields that few miniblocks need, allocated only while one of them
+// is set
 typedef struct {
-	node *head;
-	size_t size;
-	uint64_t list_size;
-} list_t;
-
-struct block_t {
+	buffer_ref_t *shared; // set if rw_buffer is shared or maps a file
+#if VMA_HEATMAP
+	uint8_t *page_heat; // counters of the pages, for big miniblocks
+#endif
+} miniblock_ext_t;
+
+// The lists are intrusive: every block and miniblock holds its own links,
+// so an element costs a single allocation. The fields used by every
+// lookup (address, size, permissions) come first, in the same cache line.
+struct miniblock_t {
 	uint64_t start_address;
-	size_t size;
-	void *miniblock_list;
+	uint64_t size;
+	unsigned int perm : 3;
+#if VMA_HEATMAP
+	// the last decay applied to the counters
+	unsigned int heat_epoch : HEAT_EPOCH_BITS;
+	uint8_t heat_read, heat_write; // saturating access counters
+#endif
+	uint32_t dirty; // bytes of rw_buffer that could have been written
+	miniblock_t *next, *prev;
+	void *rw_buffer;
+	miniblock_ext_t *ext; // NULL for most miniblocks
 };
 
-struct miniblock_t {
+// the optional fields of a miniblock
+#define miniblock_shared(mb) ((mb)->ext ? (mb)->ext->shared : NULL)
+#if VMA_HEATMAP
+#define miniblock_page_heat(mb) ((mb)->ext ? (mb)->ext->page_heat : NULL)
+#endif
+
+struct block_t {
 	uint64_t start_address;
-	size_t size;
-	uint8_t perm;
-	void *rw_buffer;
+	uint64_t size; // the sum of the sizes of its miniblocks
+	block_t *next, *prev;
+	miniblock_t *head, *tail;
+	uint64_t count; // number of miniblocks
 };
 
+// a part of the block list, displayed by one thread of PMAP
+typedef struct {
+	const block_t *first;
+	uint64_t index; // the number of its first block
+	uint64_t count; // number of blocks
+} pmap_chunk_t;
+
+// PMAP is formatted in parallel from this many miniblocks
+#define PMAP_PARALLEL_MINIBLOCKS 65536
+
+// a zone of a vectored read/write
+typedef struct {
+	uint64_t address;
+	uint64_t size;
+	long index; // position of the segment in the command
+	uint64_t offset; // position of its data in the command buffer
+	miniblock_t *mb; // miniblock that holds the address
+} segment_t;
+
+// the fragmentation histograms have a bucket for each power of two
+#define FRAG_BUCKETS 64
+
+// the work done by each step of a compaction
+#define COMPACT_STEP 16
+#define COMPACT_STEP_BYTES (1024 * 1024)
+#define COMPACT_STEP_VISITS 4096
+
+// a size of the free zones, in a treap ordered by size (and by priority
+// from the root), with the number of zones that have it
+typedef struct gap_node_t {
+	uint64_t size;
+	uint64_t count;
+	uint32_t priority;
+	struct gap_node_t *left, *right;
+} gap_node_t;
+
 typedef struct {
 	uint64_t arena_size;
-	list_t *alloc_list;
+	block_t *head;
+	uint64_t count; // number of blocks
+	uint64_t mb_count; // number of miniblocks
+	uint64_t alloc_size; // number of allocated bytes
+	buffer_cache_t cache;
+
+	// the sizes of the free zones, to know the largest one at any time
+	gap_node_t *gap_root;
+	pool_t gap_pool;
+	uint32_t gap_seed; // the priorities of the nodes
+	uint64_t largest_gap;
+
+	// fragmentation, kept up to date by the gap and block hooks
+	uint64_t gap_count;
+	uint64_t gap_hist[FRAG_BUCKETS]; // free zones by log2 of their size
+	uint64_t block_hist[FRAG_BUCKETS]; // blocks by log2 of their miniblocks
+
+	// the zone that still has to be compacted
+	int compacting;
+	uint64_t compact_start, compact_end;
+	// where the next step continues (from the head if NULL); kept valid
+	// when blocks and miniblocks are removed, merged or split
+	block_t *compact_block;
+	miniblock_t *compact_mb;
+	uint64_t compact_threshold; // miniblocks per block that start it
+
+#if VMA_HEATMAP
+	uint64_t heat_accesses;
+	uint16_t heat_epoch;
+#endif
+
+#if VMA_INDEX == VMA_INDEX_CURSOR
+	block_t *cursor; // the last block found by search_block
+#endif
+
+#if VMA_META == VMA_META_POOL
+	pool_t block_pool, miniblock_pool;
+#endif
 } arena_t;
 
+// allocate and free the metadata of the arena, as chosen by VMA_META
+#if VMA_META == VMA_META_POOL
+#define meta_alloc(arena, pool, size) pool_alloc(&(arena)->pool)
+#define meta_free(arena, pool, p) pool_free(&(arena)->pool, p)
+#else
+#define meta_alloc(arena, pool, size) ((void)(arena), malloc(size))
+#define meta_free(arena, pool, p) ((void)(arena), free(p))
+#endif
+
+// a zone of the heatmap: a miniblock or a page of a big miniblock
+typedef struct {
+	uint64_t start_address;
+	uint64_t size;
+	unsigned int heat;
+} heat_zone_t;
+
 arena_t *alloc_arena(const uint64_t size);
 
 void dealloc_arena(arena_t *arena);
 
-list_t *create_list(void);
+miniblock_t *new_miniblock(arena_t *arena, uint64_t address, uint64_t size);
+
+miniblock_ext_t *miniblock_ext(miniblock_t *mb);
 
-node *get_nth_node(list_t *list, long n);
+void trim_ext(miniblock_t *mb);
 
-node *add_nth_node(list_t *list, long n);
+uint64_t dirty_size(const miniblock_t *mb);
 
-void add_new_miniblock(node *node, uint64_t address, uint64_t size, long n);
+void set_dirty(miniblock_t *mb, uint64_t dirty);
 
-void add_new_block(arena_t *arena, uint64_t address, uint64_t size, long n);
+void insert_miniblock(arena_t *arena, block_t *block, miniblock_t *prev,
+					  miniblock_t *mb);
 
-void chain_block(node *node);
+block_t *add_new_block(arena_t *arena, uint64_t address, uint64_t size,
+					   block_t *prev);
 
-size_t list_size(list_t *list);
+void chain_block(arena_t *arena, block_t *block);
 
-int cases(node *node, const uint64_t address, const uint64_t size);
+gap_node_t *gap_rotate_left(gap_node_t *node);
+
+gap_node_t *gap_rotate_right(gap_node_t *node);
+
+gap_node_t *gap_insert(arena_t *arena, gap_node_t *node, uint64_t size);
+
+gap_node_t *gap_unlink(arena_t *arena, gap_node_t *node);
+
+gap_node_t *gap_erase(arena_t *arena, gap_node_t *node, uint64_t size);
+
+uint64_t gap_max(const gap_node_t *node);
+
+void gap_add(arena_t *arena, uint64_t size);
+
+void gap_remove(arena_t *arena, uint64_t size);
+
+void gap_margins(arena_t *arena, block_t *block, uint64_t address,
+				 uint64_t size, uint64_t *before, uint64_t *after);
+
+void gap_fill(arena_t *arena, block_t *block, uint64_t address,
+			  uint64_t size);
+
+void gap_release(arena_t *arena, block_t *block, uint64_t address,
+				 uint64_t size);
+
+uint64_t largest_gap(arena_t *arena);
+
+int frag_bucket(uint64_t x);
+
+void frag_block(arena_t *arena, uint64_t count, uint64_t new_count);
+
+void frag(const arena_t *arena);
+
+int cases(block_t *block, const uint64_t address, const uint64_t size);
 
 void find_block(arena_t *arena, const uint64_t address, const uint64_t size);
 
 void alloc_block(arena_t *arena, const uint64_t address, const uint64_t size);
 
-void remove_nth_node(list_t *list, node *node, long n, int type);
+void put_buffer(arena_t *arena, miniblock_t *mb);
 
-void search_block(list_t *list, uint64_t address, node **node_find, long *pos);
+void remove_miniblock(arena_t *arena, block_t *block, miniblock_t *mb);
 
-void
-search_miniblock1(list_t *list, uint64_t address, node **node_find, long *pos);
+void remove_block(arena_t *arena, block_t *block);
+
+block_t *search_block(arena_t *arena, uint64_t address);
+
+miniblock_t *search_miniblock1(block_t *block, uint64_t address);
+
+void split_block(arena_t *arena, block_t *block, miniblock_t *first);
 
 void free_block(arena_t *arena, const uint64_t address);
 
-void
-search_miniblock2(list_t *list, uint64_t address, node **node_find, long *pos);
+miniblock_t *search_miniblock2(block_t *block, uint64_t address);
 
 void read(arena_t *arena, uint64_t address, uint64_t size);
 
 void read_characters(uint64_t size);
 
+int check_write(arena_t *arena, const uint64_t address, const uint64_t size,
+				uint64_t *accepted);
+
 int8_t *text(arena_t *arena, const uint64_t address, const uint64_t size);
 
 void write(arena_t *arena, const uint64_t address,
@@ -90,11 +259,100 @@ void write(arena_t *arena, const uint64_t address,
 
 void printf_perm(int8_t perm);
 
+void fprintf_perm(FILE *out, int8_t perm);
+
+void pmap_header(const arena_t *arena);
+
+void pmap_block(const block_t *block, uint64_t i);
+
+void fpmap_block(FILE *out, const block_t *block, uint64_t i);
+
+void pmap_chunk(FILE *out, const void *chunk);
+
+void pmap_blocks(const block_t *first, uint64_t i, uint64_t count,
+				 uint64_t nr_minib);
+
 void pmap(const arena_t *arena);
 
+void pmap_range(const arena_t *arena, uint64_t start, uint64_t end);
+
+void pmap_summary(arena_t *arena);
+
 int permissions_cases(char *s);
 
 void mprotect(arena_t *arena, uint64_t address, int8_t *permission);
 
+int compare_segments(const void *a, const void *b);
+
+int compare_index(const void *a, const void *b);
+
+int resolve_segments(arena_t *arena, segment_t *segments, long n, int mask);
+
+void copy_from_miniblocks(miniblock_t *mb, uint64_t address, uint64_t size,
+						  int8_t *dest);
+
+void copy_to_miniblocks(miniblock_t *mb, uint64_t address, uint64_t size,
+						const int8_t *src);
+
+void read_vector(arena_t *arena, segment_t *segments, long n);
+
+int check_vector(arena_t *arena, segment_t *segments, long n);
+
+int8_t *text_vector(arena_t *arena, segment_t *segments, long n);
+
+void write_vector(arena_t *arena, segment_t *segments, long n,
+				  const int8_t *data);
+
+int find_free_zone(arena_t *arena, uint64_t size, uint64_t *address);
+
+void move_miniblock(arena_t *arena, miniblock_t *mb, uint64_t new_size);
+
+void resize(arena_t *arena, uint64_t address, uint64_t new_size, int move);
+
+void map_shared(arena_t *arena, uint64_t address, uint64_t size,
+				arena_t *source, uint64_t source_address);
+
+void map_file(arena_t *arena, uint64_t address, const char *path,
+			  uint64_t offset, uint64_t length, int shared);
+
+void sync_mapping(arena_t *arena, uint64_t address);
+
+void merge_miniblocks(arena_t *arena, block_t *block, miniblock_t *mb);
+
+void schedule_compact(arena_t *arena, uint64_t start, uint64_t end);
+
+void check_compact(arena_t *arena, block_t *block);
+
+void compact_step(arena_t *arena);
+
+void compact(arena_t *arena, int all, uint64_t address);
+
+void compact_auto(arena_t *arena, uint64_t threshold);
+
+#if VMA_HEATMAP
+void heat_sync(arena_t *arena, miniblock_t *mb);
+
+void heat_range(arena_t *arena, miniblock_t *mb, uint64_t address,
+				uint64_t size, int write);
+
+void heat_reset_pages(miniblock_t *mb);
+
+void heat_merge(miniblock_t *mb, miniblock_t *next);
+
+int compare_heat(const void *a, const void *b);
+#else
+#define heat_range(arena, mb, address, size, write) ((void)(arena))
+#define heat_reset_pages(mb) ((void)(mb))
+#define heat_merge(mb, next) ((void)(next))
+#endif
+
+void heatmap(arena_t *arena, uint64_t n);
+
+void cache_stats(const arena_t *arena);
+
+void cache_limit(arena_t *arena, uint64_t max_bytes);
+
+void metadata(const arena_t *arena);
+
 int convert(char s[]);
 